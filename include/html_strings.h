@@ -1,10 +1,6 @@
 #include "Arduino.h"
 
-#include "config.h"
-#include "index.h"
-#include "info.h"
-#include "js.h"
-#include "style.h"
-#include "ota.h"
+#include "assets_gz.h"
+#include "pages_gen.h"
 
 const char HTML_HEAD_TITLE[] PROGMEM = "Toilety";
\ No newline at end of file
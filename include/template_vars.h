@@ -0,0 +1,50 @@
+#ifndef __template_vars_h__
+#define __template_vars_h__
+
+#include "PageTemplate.h"
+
+// Every %NAME% used in ./web/*.html, rendered by renderVar() in main.cpp
+#define TEMPLATE_VARS(V)                                                       \
+  V(HTML_HEAD_TITLE)                                                           \
+  V(ASSET_VER)                                                                 \
+  V(HTML_INFO_BOX)                                                             \
+  V(UPTIME)                                                                    \
+  V(CHIP_ID)                                                                   \
+  V(FREE_HEAP)                                                                 \
+  V(SKETCH_INFO)                                                               \
+  V(HOSTNAME)                                                                  \
+  V(MY_MAC)                                                                    \
+  V(MY_RSSI)                                                                   \
+  V(FW_VER)                                                                    \
+  V(SDK_VER)                                                                   \
+  V(ABOUT_DATE)                                                                \
+  V(GRAPH_DATA)                                                                \
+  V(PROV_TIMEOUT)                                                              \
+  V(BOOT_PROFILE)                                                              \
+  V(SETTINGS_HOSTNAME)                                                         \
+  V(SETTINGS_SERVER)                                                           \
+  V(SETTINGS_PORT)                                                             \
+  V(SETTINGS_USER)
+
+#define TEMPLATE_VAR_ENUM(name) VAR_##name,
+#define TEMPLATE_VAR_NAME(name) #name,
+
+typedef enum { TEMPLATE_VARS(TEMPLATE_VAR_ENUM) VAR_COUNT } template_var_t;
+
+constexpr const char *TEMPLATE_VAR_NAMES[] = {TEMPLATE_VARS(TEMPLATE_VAR_NAME)};
+
+constexpr bool templateStrEq(const char *a, const char *b)
+{
+  return *a == *b && (*a == '\0' || templateStrEq(a + 1, b + 1));
+}
+
+// Placeholder name to enum ID, resolved by the compiler in the generated pages
+constexpr uint8_t templateVar(const char *name, uint8_t i = 0)
+{
+  return i == VAR_COUNT ? TEMPLATE_VAR_NONE
+         : templateStrEq(TEMPLATE_VAR_NAMES[i], name)
+             ? i
+             : templateVar(name, i + 1);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include "Cooling.h"
+
+#include <Preferences.h>
+#include <math.h>
+
+static const char *NAMESPACE = "cooling";
+static const char *KEY       = "k";
+
+// degC above ambient, below that the log amplifies sensor noise
+#define COOLING_MIN_DELTA 20.0f
+// weight of a new run in the baseline
+#define COOLING_LEARN     0.3f
+
+void CoolingFit::reset()
+{
+  mCount = 0;
+  mSumT  = 0;
+  mSumY  = 0;
+  mSumTT = 0;
+  mSumTY = 0;
+}
+
+bool CoolingFit::add(float minutes, float temp, float ambient)
+{
+  if (isnan(temp) || temp - ambient < COOLING_MIN_DELTA)
+    return false;
+
+  double y = log(temp - ambient);
+  mCount++;
+  mSumT += minutes;
+  mSumY += y;
+  mSumTT += (double)minutes * minutes;
+  mSumTY += minutes * y;
+  return true;
+}
+
+float CoolingFit::rate() const
+{
+  double det = mCount * mSumTT - mSumT * mSumT;
+  if (mCount < 2 || det <= 0)
+    return 0;
+  // the slope of ln(T - Ta) is -k
+  return -(mCount * mSumTY - mSumT * mSumY) / det;
+}
+
+float coolingBaselineLoad()
+{
+  Preferences prefs;
+
+  if (!prefs.begin(NAMESPACE, true))
+    return 0;
+  float k = prefs.getFloat(KEY, 0);
+  prefs.end();
+  return k;
+}
+
+float coolingBaselineLearn(float rate)
+{
+  Preferences prefs;
+
+  if (!prefs.begin(NAMESPACE, false))
+    return rate;
+  float k = prefs.getFloat(KEY, 0);
+  k       = k > 0 ? k + COOLING_LEARN * (rate - k) : rate;
+  prefs.putFloat(KEY, k);
+  prefs.end();
+  return k;
+}
@@ -0,0 +1,33 @@
+#ifndef __cooling_h__
+#define __cooling_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Newton cooling T(t) = Ta + (T0 - Ta) * e^(-k t), fitted online as a line
+// through ln(T - Ta) so no samples are kept. k is per minute.
+class CoolingFit
+{
+  uint32_t mCount;
+  double mSumT;
+  double mSumY;
+  double mSumTT;
+  double mSumTY;
+
+public:
+  CoolingFit() { reset(); }
+
+  void reset();
+  // false when temp is too close to ambient to say anything
+  bool add(float minutes, float temp, float ambient);
+  // 0 until there are at least two samples
+  float rate() const;
+  uint32_t samples() const { return mCount; }
+};
+
+// Learned healthy cooling rate from previous runs, 0 if none yet
+float coolingBaselineLoad();
+// Blend a healthy run into the stored baseline
+float coolingBaselineLearn(float rate);
+
+#endif // __cooling_h__
@@ -0,0 +1,110 @@
+#include "CrashReport.h"
+
+#include <Preferences.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_core_dump.h"
+#include "esp_partition.h"
+
+static const char *NAMESPACE = "crash";
+static const char *KEY       = "reported";
+
+#if CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH && CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF
+#define CRASH_SUPPORTED 1
+#else
+#define CRASH_SUPPORTED 0
+#endif
+
+static const esp_partition_t *partition()
+{
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ESP_PARTITION_SUBTYPE_DATA_COREDUMP, NULL);
+}
+
+bool crashLoad(crash_t *c)
+{
+  memset(c, 0, sizeof(*c));
+#if CRASH_SUPPORTED
+  size_t addr;
+  esp_core_dump_summary_t summary;
+
+  if (esp_core_dump_image_get(&addr, &c->size) != ESP_OK ||
+      esp_core_dump_get_summary(&summary) != ESP_OK)
+    return false;
+
+  strncpy(c->task, summary.exc_task, sizeof(c->task) - 1);
+  strncpy(c->elfSha, (const char *)summary.app_elf_sha256,
+          sizeof(c->elfSha) - 1);
+  c->pc        = summary.exc_pc;
+  c->cause     = summary.ex_info.exc_cause;
+  c->vaddr     = summary.ex_info.exc_vaddr;
+  c->depth     = summary.exc_bt_info.depth < CRASH_BT_MAX
+                     ? summary.exc_bt_info.depth
+                     : CRASH_BT_MAX;
+  c->corrupted = summary.exc_bt_info.corrupted;
+  memcpy(c->bt, summary.exc_bt_info.bt, c->depth * sizeof(c->bt[0]));
+  return true;
+#else
+  return false;
+#endif
+}
+
+size_t crashJson(const crash_t *c, char *buf, size_t size)
+{
+  int n = snprintf(buf, size,
+                   "{\"task\":\"%s\",\"pc\":\"0x%08x\",\"cause\":%u,"
+                   "\"vaddr\":\"0x%08x\",\"elf\":\"%s\",\"corrupted\":%s,"
+                   "\"size\":%u,\"bt\":[",
+                   c->task, c->pc, c->cause, c->vaddr, c->elfSha,
+                   c->corrupted ? "true" : "false", (unsigned)c->size);
+  for (uint8_t i = 0; i < c->depth && n > 0 && (size_t)n < size; i++)
+    n += snprintf(buf + n, size - n, "%s\"0x%08x\"", i ? "," : "", c->bt[i]);
+  if (n > 0 && (size_t)n < size)
+    n += snprintf(buf + n, size - n, "]}");
+  return n < 0 ? 0 : ((size_t)n < size ? n : size - 1);
+}
+
+bool crashRead(size_t offset, uint8_t *buf, size_t len)
+{
+  const esp_partition_t *p = partition();
+  return p && esp_partition_read(p, offset, buf, len) == ESP_OK;
+}
+
+// same crash, same key
+static uint32_t crashId(const crash_t *c)
+{
+  uint32_t h = 2166136261u;
+  const uint8_t *b = (const uint8_t *)c;
+  for (size_t i = 0; i < sizeof(*c); i++)
+    h = (h ^ b[i]) * 16777619u;
+  return h;
+}
+
+bool crashReported(const crash_t *c)
+{
+  Preferences prefs;
+
+  if (!prefs.begin(NAMESPACE, true))
+    return false;
+  bool reported = prefs.getUInt(KEY, 0) == crashId(c);
+  prefs.end();
+  return reported;
+}
+
+void crashMarkReported(const crash_t *c)
+{
+  Preferences prefs;
+
+  if (!prefs.begin(NAMESPACE, false))
+    return;
+  prefs.putUInt(KEY, crashId(c));
+  prefs.end();
+}
+
+bool crashErase()
+{
+  const esp_partition_t *p = partition();
+  // a blank header is no image, the rest is overwritten by the next dump
+  return p && esp_partition_erase_range(p, 0, SPI_FLASH_SEC_SIZE) == ESP_OK;
+}
@@ -0,0 +1,39 @@
+#ifndef __crash_report_h__
+#define __crash_report_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Summary of the core dump the panic handler left in the coredump
+// partition, decoded on the host by tools/crash_decode.py.
+// Needs CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH with the ELF data format,
+// without it crashLoad() always returns false.
+
+#define CRASH_BT_MAX 16
+
+typedef struct {
+  char task[16];
+  uint32_t pc;
+  uint32_t cause; // Xtensa EXCCAUSE
+  uint32_t vaddr; // EXCVADDR
+  uint32_t bt[CRASH_BT_MAX];
+  uint8_t depth;
+  bool corrupted;
+  char elfSha[17]; // app ELF SHA-256 prefix of the crashed firmware
+  size_t size;     // core dump image bytes, for /coredump
+} crash_t;
+
+// true if there is a core dump, fills c with its summary
+bool crashLoad(crash_t *c);
+// {"task":..,"pc":"0x..",..,"bt":["0x..",..]}
+size_t crashJson(const crash_t *c, char *buf, size_t size);
+// Reads the raw image for espcoredump.py
+bool crashRead(size_t offset, uint8_t *buf, size_t len);
+
+// Reported crashes are remembered in NVS so a dump is shipped once
+bool crashReported(const crash_t *c);
+void crashMarkReported(const crash_t *c);
+// Invalidates the stored image
+bool crashErase();
+
+#endif // __crash_report_h__
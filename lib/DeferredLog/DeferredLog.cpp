@@ -0,0 +1,270 @@
+#include "DeferredLog.h"
+
+#include <Arduino.h>
+
+#include "esp_attr.h"
+#include "esp_ota_ops.h"
+#include "soc/soc.h"
+
+// [len][module << 4 | level][uint32_t ms][uint32_t fmt][args], len is
+// written last and marks the record complete
+#define LOG_HEADER 10
+#define LOG_MASK   (LOG_RING_BYTES - 1)
+
+// a frame on the wire is LOG_SYNC followed by one record
+static const uint8_t LOG_SYNC[] = {0xD1, 0x06};
+
+#define LOG_MODULE_NAME(id, name) name,
+const char *const LOG_MODULE_NAMES[LOG_MODULE_COUNT] = {
+    LOG_MODULES(LOG_MODULE_NAME)};
+
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_DEBUG
+#endif
+
+#define LOG_LEVEL_INIT(id, name) LOG_LEVEL_DEFAULT,
+volatile uint8_t logLevels[LOG_MODULE_COUNT] = {LOG_MODULES(LOG_LEVEL_INIT)};
+
+static uint8_t ring[LOG_RING_BYTES];
+static uint32_t reserved = 0; // bytes handed to writers, wraps
+static uint32_t consumed = 0; // bytes drained, wraps
+static uint32_t dropped  = 0;
+
+static Print *output     = NULL;
+
+// The last records written out, in RTC memory that survives a panic or
+// watchdog reset. tag marks them as written by this firmware.
+#define LOG_SLOT                                                               \
+  (LOG_HEADER +                                                                \
+   (LOG_ARGS_MAX > LOG_TEXT_MAX + 1 ? LOG_ARGS_MAX : LOG_TEXT_MAX + 1))
+typedef struct {
+  uint32_t tag;
+  uint32_t count;
+  uint8_t lines[LOG_HISTORY][LOG_SLOT];
+} log_history_t;
+
+RTC_NOINIT_ATTR static log_history_t history;
+static log_history_t previous; // copy taken by logBegin()
+
+static uint32_t historyTag()
+{
+  // changes with the firmware, format string addresses do too
+  uint32_t tag;
+  memcpy(&tag, esp_ota_get_app_description()->app_elf_sha256, sizeof(tag));
+  return tag ^ 0x4C4F4748;
+}
+
+static void ringPut(uint32_t pos, const void *src, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    ring[(pos + i) & LOG_MASK] = ((const uint8_t *)src)[i];
+}
+
+void logPush(uint8_t module, uint8_t level, const char *fmt,
+             const uint8_t *args, size_t len)
+{
+  uint8_t size  = LOG_HEADER + len;
+  uint32_t head = __atomic_load_n(&reserved, __ATOMIC_RELAXED);
+
+  // claim space without a lock, any task may log
+  do {
+    if (head + size - __atomic_load_n(&consumed, __ATOMIC_ACQUIRE) >
+        LOG_RING_BYTES) {
+      __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  } while (!__atomic_compare_exchange_n(&reserved, &head, head + size, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+  uint8_t tag   = module << 4 | level;
+  uint32_t ms   = millis();
+  uint32_t addr = (uintptr_t)fmt;
+  ringPut(head + 1, &tag, 1);
+  ringPut(head + 2, &ms, 4);
+  ringPut(head + 6, &addr, 4);
+  ringPut(head + LOG_HEADER, args, len);
+  __atomic_store_n(&ring[head & LOG_MASK], size, __ATOMIC_RELEASE);
+}
+
+// Packed like any %s, only the limit is LOG_TEXT_MAX
+void logText(uint8_t module, uint8_t level, const char *fmt, const char *text)
+{
+  uint8_t buf[1 + LOG_TEXT_MAX];
+  size_t len = text ? strnlen(text, LOG_TEXT_MAX) : 0;
+  buf[0]     = len;
+  memcpy(buf + 1, text, len);
+  logPush(module, level, fmt, buf, 1 + len);
+}
+
+// printf() one packed line, mirrors tools/dlog_decode.py
+static size_t logFormat(char *out, size_t size, const char *fmt,
+                        const uint8_t *arg, const uint8_t *end)
+{
+  size_t n = 0;
+
+  while (*fmt && n + 1 < size) {
+    if (*fmt != '%' || fmt[1] == '%') {
+      out[n++] = *fmt;
+      fmt += *fmt == '%' ? 2 : 1;
+      continue;
+    }
+
+    // %[flags][width][.precision][length]conversion, length is rebuilt
+    char spec[16] = "%";
+    size_t s      = 1;
+    bool wide     = false;
+    for (fmt++; *fmt && !strchr("diouxXcsfFeEgGaAp", *fmt); fmt++) {
+      if (*fmt == 'l' && fmt[1] == 'l')
+        wide = true;
+      if (!strchr("lhzjtL", *fmt) && s < sizeof(spec) - 4)
+        spec[s++] = *fmt;
+    }
+    if (!*fmt)
+      break;
+    char conv = *fmt++;
+    if (wide) {
+      spec[s++] = 'l';
+      spec[s++] = 'l';
+    }
+    spec[s++] = conv;
+    spec[s]   = '\0';
+
+    int w = 0;
+    if (strchr("fFeEgGaA", conv) && arg + 8 <= end) {
+      double v;
+      memcpy(&v, arg, 8);
+      arg += 8;
+      w = snprintf(out + n, size - n, spec, v);
+    } else if (conv == 's' && arg < end && arg + 1 + arg[0] <= end) {
+      char str[LOG_TEXT_MAX + 1];
+      memcpy(str, arg + 1, arg[0]);
+      str[arg[0]] = '\0';
+      arg += 1 + arg[0];
+      w = snprintf(out + n, size - n, spec, str);
+    } else if (wide && arg + 8 <= end) {
+      long long v;
+      memcpy(&v, arg, 8);
+      arg += 8;
+      w = snprintf(out + n, size - n, spec, v);
+    } else if (!wide && arg + 4 <= end) {
+      int v;
+      memcpy(&v, arg, 4);
+      arg += 4;
+      w = conv == 'p' ? snprintf(out + n, size - n, "%p", (void *)(uintptr_t)v)
+                      : snprintf(out + n, size - n, spec, v);
+    } else {
+      w = snprintf(out + n, size - n, "%s", spec);
+    }
+    if (w > 0)
+      n += min((size_t)w, size - 1 - n);
+  }
+
+  out[n] = '\0';
+  return n;
+}
+
+// "[ms] module: text" of one record
+static size_t logLine(char *out, size_t size, const uint8_t *record)
+{
+  uint32_t ms, fmt;
+  memcpy(&ms, record + 2, 4);
+  memcpy(&fmt, record + 6, 4);
+  uint8_t module = record[1] >> 4;
+
+  int n          = snprintf(out, size, "[%u] %s: ", ms,
+                            module < LOG_MODULE_COUNT ? LOG_MODULE_NAMES[module]
+                                                      : "?");
+  if (n < 0 || (size_t)n >= size)
+    return 0;
+  if (record[1] & LOG_TRUNCATED) {
+    strlcpy(out + n, (const char *)fmt, size - n);
+    return strlen(out);
+  }
+  return n + logFormat(out + n, size - n, (const char *)fmt,
+                       record + LOG_HEADER, record + record[0]);
+}
+
+static void logTask(void *arg)
+{
+  uint8_t record[255];
+
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(20));
+
+    for (;;) {
+      uint32_t tail = __atomic_load_n(&consumed, __ATOMIC_RELAXED);
+      uint8_t size  = __atomic_load_n(&ring[tail & LOG_MASK], __ATOMIC_ACQUIRE);
+      // empty, or the next writer has not finished yet
+      if (!size)
+        break;
+
+      for (uint8_t i = 0; i < size; i++) {
+        record[i]                   = ring[(tail + i) & LOG_MASK];
+        ring[(tail + i) & LOG_MASK] = 0;
+      }
+      __atomic_store_n(&consumed, tail + size, __ATOMIC_RELEASE);
+
+      memcpy(history.lines[history.count++ % LOG_HISTORY], record, size);
+
+#ifdef LOG_TEXT
+      char line[192];
+      logLine(line, sizeof(line), record);
+      output->print(line);
+#else
+      output->write(LOG_SYNC, sizeof(LOG_SYNC));
+      output->write(record, size);
+#endif
+    }
+  }
+}
+
+void logBegin(Print *out)
+{
+  output = out;
+
+  // keep what the previous boot left, then start over
+  uint32_t tag = historyTag();
+  if (history.tag == tag)
+    previous = history;
+  memset(&history, 0, sizeof(history));
+  history.tag = tag;
+
+  // with the rest of the I/O, APP_CPU is kept for control
+  xTaskCreatePinnedToCore(logTask, "log", 3072, NULL, tskIDLE_PRIORITY + 1,
+                          NULL, PRO_CPU_NUM);
+}
+
+bool logSetLevel(const char *module, uint8_t level)
+{
+  for (int i = 0; i < LOG_MODULE_COUNT; i++) {
+    if (!strcmp(module, LOG_MODULE_NAMES[i])) {
+      logLevels[i] = level > LOG_DEBUG ? LOG_DEBUG : level;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t logDropped() { return dropped; }
+
+size_t logPrevious(char *out, size_t size)
+{
+  size_t n     = 0;
+  uint32_t end = previous.count;
+  uint32_t i   = end > LOG_HISTORY ? end - LOG_HISTORY : 0;
+
+  if (size)
+    out[0] = '\0';
+  for (; i < end && n + 1 < size; i++) {
+    const uint8_t *record = previous.lines[i % LOG_HISTORY];
+    if (record[0] < LOG_HEADER || record[0] > LOG_SLOT)
+      continue;
+    n += logLine(out + n, size - n, record);
+    // lines carry their own newline, make sure each ends with one
+    if (n && n + 1 < size && out[n - 1] != '\n') {
+      out[n++] = '\n';
+      out[n]   = '\0';
+    }
+  }
+  return n;
+}
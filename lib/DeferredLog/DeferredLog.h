@@ -0,0 +1,137 @@
+#ifndef __deferred_log_h__
+#define __deferred_log_h__
+
+#include <Print.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Deferred logging: the caller stores the address of the format string and
+// the raw arguments in a lock-free ring, logTask() writes them out later.
+// Binary frames are turned back into text on the host from the ELF with
+// tools/dlog_decode.py, -D LOG_TEXT formats them on the device instead.
+
+#define LOG_MODULES(M)                                                         \
+  M(MAIN, "main")                                                              \
+  M(CONTROL, "control")                                                        \
+  M(SAFETY, "safety")                                                          \
+  M(NET, "net")
+
+#define LOG_MODULE_ENUM(id, name) LOG_##id,
+typedef enum { LOG_MODULES(LOG_MODULE_ENUM) LOG_MODULE_COUNT } log_module_t;
+
+typedef enum {
+  LOG_OFF,
+  LOG_ERROR,
+  LOG_WARN,
+  LOG_INFO,
+  LOG_DEBUG,
+} log_level_t;
+
+#define LOG_RING_BYTES 4096 // power of two
+#define LOG_ARGS_MAX   64   // packed argument bytes per line
+#define LOG_STR_MAX    32   // %s arguments are copied up to this length
+#define LOG_TEXT_MAX   160  // the one string of a LOG_TEXT() line
+#define LOG_TRUNCATED  0x08 // in the level byte, arguments did not fit
+#define LOG_HISTORY    16   // last lines kept across a reset for crash reports
+
+extern const char *const LOG_MODULE_NAMES[LOG_MODULE_COUNT];
+extern volatile uint8_t logLevels[LOG_MODULE_COUNT];
+
+#define LOG(module, level, fmt, ...)                                           \
+  do {                                                                         \
+    if ((level) <= logLevels[module])                                          \
+      logWrite(module, level, fmt, ##__VA_ARGS__);                             \
+  } while (0)
+
+// A line whose only argument is a whole message, fmt has a single %s
+#define LOG_TEXT(module, level, fmt, text)                                     \
+  do {                                                                         \
+    if ((level) <= logLevels[module])                                          \
+      logText(module, level, fmt, text);                                       \
+  } while (0)
+
+// Starts the drain task writing to out
+void logBegin(Print *out);
+bool logSetLevel(const char *module, uint8_t level);
+// Lines lost to a full ring
+uint32_t logDropped();
+// The last LOG_HISTORY lines before the previous reset as text, one per
+// line. Only valid after logBegin() and when the same firmware wrote them.
+size_t logPrevious(char *out, size_t size);
+
+void logPush(uint8_t module, uint8_t level, const char *fmt,
+             const uint8_t *args, size_t len);
+void logText(uint8_t module, uint8_t level, const char *fmt, const char *text);
+
+// Arguments are packed like varargs after promotion: 4 byte integers,
+// 8 byte long long and double, strings as a length byte and the bytes.
+// A return of 0 means no room left.
+inline size_t logArg(uint8_t *p, size_t room, const void *v, size_t len)
+{
+  if (len > room)
+    return 0;
+  memcpy(p, v, len);
+  return len;
+}
+inline size_t logArg(uint8_t *p, size_t room, int v)
+{
+  return logArg(p, room, &v, 4);
+}
+inline size_t logArg(uint8_t *p, size_t room, unsigned v)
+{
+  return logArg(p, room, &v, 4);
+}
+inline size_t logArg(uint8_t *p, size_t room, long v)
+{
+  return logArg(p, room, &v, 4);
+}
+inline size_t logArg(uint8_t *p, size_t room, unsigned long v)
+{
+  return logArg(p, room, &v, 4);
+}
+inline size_t logArg(uint8_t *p, size_t room, long long v)
+{
+  return logArg(p, room, &v, 8);
+}
+inline size_t logArg(uint8_t *p, size_t room, unsigned long long v)
+{
+  return logArg(p, room, &v, 8);
+}
+inline size_t logArg(uint8_t *p, size_t room, double v)
+{
+  return logArg(p, room, &v, 8);
+}
+inline size_t logArg(uint8_t *p, size_t room, const char *v)
+{
+  size_t len = v ? strnlen(v, LOG_STR_MAX) : 0;
+  if (len + 1 > room)
+    return 0;
+  p[0] = len;
+  memcpy(p + 1, v, len);
+  return len + 1;
+}
+
+inline size_t logPack(uint8_t *p, size_t room) { return 0; }
+
+template <typename T, typename... R>
+size_t logPack(uint8_t *p, size_t room, T v, R... rest)
+{
+  size_t n = logArg(p, room, v);
+  if (!n)
+    return 0;
+  size_t m = logPack(p + n, room - n, rest...);
+  return sizeof...(rest) && !m ? 0 : n + m;
+}
+
+template <typename... A>
+void logWrite(uint8_t module, uint8_t level, const char *fmt, A... args)
+{
+  uint8_t buf[LOG_ARGS_MAX];
+  size_t n = logPack(buf, sizeof(buf), args...);
+  if (!n && sizeof...(args))
+    level |= LOG_TRUNCATED;
+  logPush(module, level, fmt, buf, n);
+}
+
+#endif // __deferred_log_h__
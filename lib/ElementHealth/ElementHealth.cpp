@@ -0,0 +1,56 @@
+#include "ElementHealth.h"
+
+#include <Preferences.h>
+#include <string.h>
+
+static const char *NAMESPACE = "element";
+static const char *KEY       = "history";
+
+bool elementHistoryLoad(element_history_t *h)
+{
+  Preferences prefs;
+
+  memset(h, 0, sizeof(*h));
+  if (!prefs.begin(NAMESPACE, true))
+    return false;
+  // a different layout is dropped, the trend rebuilds in a few runs
+  bool ok = prefs.getBytesLength(KEY) == sizeof(*h) &&
+            prefs.getBytes(KEY, h, sizeof(*h)) == sizeof(*h);
+  prefs.end();
+
+  if (!ok)
+    memset(h, 0, sizeof(*h));
+  return ok;
+}
+
+bool elementHistoryAdd(element_history_t *h, const element_run_t &run)
+{
+  Preferences prefs;
+
+  h->runs[h->count % ELEMENT_HISTORY] = run;
+  h->count++;
+
+  if (!prefs.begin(NAMESPACE, false))
+    return false;
+  bool ok = prefs.putBytes(KEY, h, sizeof(*h)) == sizeof(*h);
+  prefs.end();
+  return ok;
+}
+
+bool elementTrend(const element_history_t *h, element_run_t *mean)
+{
+  uint16_t n = h->count < ELEMENT_HISTORY ? h->count : ELEMENT_HISTORY;
+  if (n < 2)
+    return false;
+
+  mean->power      = 0;
+  mean->rise = 0;
+  for (uint16_t i = 1; i < n; i++) {
+    const element_run_t &r = h->runs[(h->count - 1 - i) % ELEMENT_HISTORY];
+    mean->power += r.power;
+    mean->rise += r.rise;
+  }
+  mean->power /= n - 1;
+  mean->rise /= n - 1;
+  return true;
+}
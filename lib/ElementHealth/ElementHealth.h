@@ -0,0 +1,26 @@
+#ifndef __element_health_h__
+#define __element_health_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ELEMENT_HISTORY 16 // runs kept in NVS
+
+// One firing, measured over its ramps only so holds don't skew it
+typedef struct {
+  float power;      // W while the relay was on, from S0 energy
+  float rise;       // degC per kWh, falls as the element wears or scales
+} element_run_t;
+
+typedef struct {
+  uint16_t count; // runs ever recorded, the newest is at (count - 1) % size
+  element_run_t runs[ELEMENT_HISTORY];
+} element_history_t;
+
+bool elementHistoryLoad(element_history_t *h);
+bool elementHistoryAdd(element_history_t *h, const element_run_t &run);
+
+// Mean of the stored runs except the newest, false if there are none
+bool elementTrend(const element_history_t *h, element_run_t *mean);
+
+#endif // __element_health_h__
@@ -209,9 +209,8 @@ void LCD16x2::lcdWrite(char* string){
 }
 
 void LCD16x2::lcdWrite(int intVal){
-    String Str = String (intVal);
-    char charBuf[6];
-    Str.toCharArray(charBuf, 6);
+    char charBuf[12];
+    snprintf(charBuf, sizeof(charBuf), "%d", intVal);
     lcdWrite(charBuf);
 }
 
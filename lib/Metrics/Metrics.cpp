@@ -0,0 +1,73 @@
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int metricsChunk(int *item, metrics_item_t fn, uint8_t *buf, size_t maxLen)
+{
+  size_t n = 0;
+  char line[METRICS_ITEM_MAX];
+
+  for (;;) {
+    int len = fn(*item, line, sizeof(line));
+    if (len < 0)
+      return n; // past the last block, end of response
+    if ((size_t)len >= sizeof(line))
+      len = sizeof(line) - 1;
+    if ((size_t)len > maxLen - n)
+      break;
+    memcpy(buf + n, line, len);
+    n += len;
+    (*item)++;
+  }
+
+  // not enough room for a whole block, ask again once the socket drained
+  return n ? (int)n : -1;
+}
+
+int metricsElement(char *buf, size_t size, const element_run_t &run,
+                   const element_history_t *h, bool alarm)
+{
+  element_run_t trend;
+  bool hasTrend = elementTrend(h, &trend);
+  return snprintf(
+      buf, size,
+      "# HELP kiln_element_power_watts Effective power over the last run's "
+      "ramps\n"
+      "kiln_element_power_watts %.0f\n"
+      "kiln_element_power_trend_watts %.0f\n"
+      "# HELP kiln_element_rise_celsius_per_kwh Temperature rise per kWh "
+      "over the last run's ramps\n"
+      "kiln_element_rise_celsius_per_kwh %.1f\n"
+      "kiln_element_rise_trend_celsius_per_kwh %.1f\n"
+      "kiln_element_runs %u\n"
+      "kiln_element_alarm %u\n",
+      run.power, hasTrend ? trend.power : 0, run.rise,
+      hasTrend ? trend.rise : 0, h->count, alarm);
+}
+
+int metricsProbe(char *buf, size_t size, int probe, const probe_sample_t &s,
+                 float health)
+{
+  return snprintf(buf, size,
+                  "kiln_probe_temperature_celsius{probe=\"%d\"} %.1f\n"
+                  "kiln_probe_health{probe=\"%d\"} %.2f\n"
+                  "kiln_probe_error{probe=\"%d\"} %u\n",
+                  probe, s.temp, probe, health, probe, s.error);
+}
+
+int metricsZone(char *buf, size_t size, int zone, float temp, float setpoint,
+                int step, bool relay, uint32_t eta)
+{
+  int n = snprintf(buf, size,
+                   "kiln_zone_temperature_celsius{zone=\"%d\"} %.1f\n"
+                   "kiln_zone_setpoint_celsius{zone=\"%d\"} %.1f\n"
+                   "kiln_zone_step{zone=\"%d\"} %d\n"
+                   "kiln_zone_relay{zone=\"%d\"} %d\n",
+                   zone, temp, zone, setpoint, zone, step, zone, relay);
+  // no sample while a paused zone has no end in sight
+  if (eta != ZONE_ETA_UNKNOWN && n > 0 && (size_t)n < size)
+    n += snprintf(buf + n, size - n,
+                  "kiln_zone_remaining_seconds{zone=\"%d\"} %u\n", zone, eta);
+  return n;
+}
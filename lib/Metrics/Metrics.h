@@ -0,0 +1,33 @@
+#ifndef __metrics_h__
+#define __metrics_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ElementHealth.h"
+#include "ThermoFusion.h"
+#include "Zone.h"
+
+// Prometheus text for /metrics, one block of samples per item so a
+// chunked response streams it from caller buffers, never from the heap.
+
+#define METRICS_ITEM_MAX 512 // largest block of samples
+
+// Formats block item into buf, -1 past the last one
+typedef int (*metrics_item_t)(int item, char *buf, size_t size);
+
+// Copies whole blocks from *item on into buf and advances it. 0 once the
+// blocks ran out, -1 if the next one does not fit into maxLen at all.
+int metricsChunk(int *item, metrics_item_t fn, uint8_t *buf, size_t maxLen);
+
+// Last run and trend of the element, see elementCheck()
+int metricsElement(char *buf, size_t size, const element_run_t &run,
+                   const element_history_t *h, bool alarm);
+// One thermocouple and its health
+int metricsProbe(char *buf, size_t size, int probe, const probe_sample_t &s,
+                 float health);
+// One zone, eta in s or ZONE_ETA_UNKNOWN which leaves its sample out
+int metricsZone(char *buf, size_t size, int zone, float temp, float setpoint,
+                int step, bool relay, uint32_t eta);
+
+#endif // __metrics_h__
@@ -0,0 +1,291 @@
+#include "DeltaPatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp32/rom/miniz.h"
+#include "esp_log.h"
+
+static const char *TAG         = "delta";
+static const uint8_t MAGIC[4]  = {'K', 'D', 'L', 'T'};
+static const uint8_t VERSION   = 1;
+static const size_t OLD_CHUNK  = 256;
+
+DeltaPatch::DeltaPatch()
+{
+  mOta      = NULL;
+  mOld      = NULL;
+  mInflator = NULL;
+  mDict     = NULL;
+  mActive   = false;
+  mError    = NULL;
+}
+
+bool DeltaPatch::isPatch(const uint8_t *data, size_t len)
+{
+  return len >= sizeof(MAGIC) && !memcmp(data, MAGIC, sizeof(MAGIC));
+}
+
+void DeltaPatch::release()
+{
+  free(mInflator);
+  free(mDict);
+  mInflator = NULL;
+  mDict     = NULL;
+}
+
+void DeltaPatch::fail(const char *error)
+{
+  if (!mError)
+    mError = error;
+  ESP_LOGE(TAG, "%s", error);
+  stop();
+}
+
+void DeltaPatch::stop()
+{
+  release();
+  if (mActive && mOta)
+    mOta->abort();
+  mActive = false;
+}
+
+bool DeltaPatch::begin(OtaStream *ota)
+{
+  if (mActive)
+    stop();
+
+  mOta       = ota;
+  mOld       = esp_ota_get_running_partition();
+  mHeaderLen = 0;
+  mNewSize   = 0;
+  mProduced  = 0;
+  mDictPos   = 0;
+  mState     = ST_EXTRA_LEN;
+  mVarint    = 0;
+  mShift     = 0;
+  mOldPos    = 0;
+  mError     = NULL;
+  mActive    = true;
+  return true;
+}
+
+// "KDLT" | version | 3 reserved | u32 new size | new SHA-256 | old ELF SHA-256
+bool DeltaPatch::header()
+{
+  if (memcmp(mHeader, MAGIC, sizeof(MAGIC)) || mHeader[4] != VERSION) {
+    fail("unsupported patch");
+    return false;
+  }
+
+  mNewSize = mHeader[8] | mHeader[9] << 8 | mHeader[10] << 16 |
+             (uint32_t)mHeader[11] << 24;
+
+  // the patch only applies to the exact image it was built against
+  const esp_app_desc_t *app = esp_ota_get_app_description();
+  if (memcmp(mHeader + 44, app->app_elf_sha256, 32)) {
+    fail("patch was built for another firmware");
+    return false;
+  }
+
+  char sha256[65];
+  for (int i = 0; i < 32; i++)
+    sprintf(sha256 + 2 * i, "%02x", mHeader[12 + i]);
+
+  if (!mOta->begin(mNewSize, sha256)) {
+    fail(mOta->error());
+    return false;
+  }
+
+  mInflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+  mDict     = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+  if (!mInflator || !mDict) {
+    fail("out of memory");
+    return false;
+  }
+  tinfl_init(mInflator);
+
+  ESP_LOGI(TAG, "patch to %u bytes from %s", mNewSize, mOld->label);
+  return true;
+}
+
+bool DeltaPatch::write(const uint8_t *data, size_t len)
+{
+  if (!mActive)
+    return false;
+
+  if (mHeaderLen < DELTA_HEADER_SIZE) {
+    size_t c = DELTA_HEADER_SIZE - mHeaderLen;
+    if (c > len)
+      c = len;
+    memcpy(mHeader + mHeaderLen, data, c);
+    mHeaderLen += c;
+    data += c;
+    len -= c;
+    if (mHeaderLen < DELTA_HEADER_SIZE)
+      return true;
+    if (!header())
+      return false;
+  }
+
+  return inflate(data, len);
+}
+
+bool DeltaPatch::inflate(const uint8_t *data, size_t len)
+{
+  for (;;) {
+    size_t inLen  = len;
+    size_t outLen = TINFL_LZ_DICT_SIZE - mDictPos;
+
+    // the dictionary doubles as the output buffer and wraps around
+    tinfl_status status =
+        tinfl_decompress(mInflator, data, &inLen, mDict, mDict + mDictPos,
+                         &outLen, TINFL_FLAG_HAS_MORE_INPUT);
+    data += inLen;
+    len -= inLen;
+
+    if (outLen && !consume(mDict + mDictPos, outLen))
+      return false;
+    mDictPos = (mDictPos + outLen) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if (status < TINFL_STATUS_DONE) {
+      fail("corrupt patch");
+      return false;
+    }
+    if (status == TINFL_STATUS_DONE)
+      return true;
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT && !len)
+      return true;
+  }
+}
+
+bool DeltaPatch::output(const uint8_t *data, size_t len)
+{
+  if (!mOta->write(data, len)) {
+    fail(mOta->error());
+    return false;
+  }
+  mProduced += len;
+  return true;
+}
+
+// Operations: extra_len, seek, diff_len varints then extra and diff bytes
+bool DeltaPatch::consume(const uint8_t *data, size_t len)
+{
+  while (len) {
+    switch (mState) {
+    case ST_EXTRA_LEN:
+    case ST_SEEK:
+    case ST_DIFF_LEN: {
+      uint8_t b = *data++;
+      len--;
+      mVarint |= (uint32_t)(b & 0x7F) << mShift;
+      mShift += 7;
+      if (b & 0x80) {
+        if (mShift > 28) {
+          fail("corrupt patch");
+          return false;
+        }
+        break;
+      }
+
+      uint32_t v = mVarint;
+      mVarint    = 0;
+      mShift     = 0;
+
+      if (mState == ST_EXTRA_LEN) {
+        mExtraLen = v;
+        mState    = ST_SEEK;
+      } else if (mState == ST_SEEK) {
+        mSeek  = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+        mState = ST_DIFF_LEN;
+      } else {
+        mDiffLen = v;
+        int64_t pos = (int64_t)mOldPos + mSeek;
+        if (pos < 0 || pos + mDiffLen > mOld->size ||
+            mProduced + mExtraLen + mDiffLen > mNewSize) {
+          fail("corrupt patch");
+          return false;
+        }
+        mOldPos = pos;
+        mState  = ST_EXTRA;
+      }
+      break;
+    }
+
+    case ST_EXTRA: {
+      size_t c = mExtraLen < len ? mExtraLen : len;
+      if (c && !output(data, c))
+        return false;
+      data += c;
+      len -= c;
+      mExtraLen -= c;
+      if (!mExtraLen)
+        mState = ST_DIFF;
+      break;
+    }
+
+    case ST_DIFF: {
+      uint8_t old[OLD_CHUNK];
+      size_t c = mDiffLen < len ? mDiffLen : len;
+      if (c > sizeof(old))
+        c = sizeof(old);
+
+      if (c) {
+        if (esp_partition_read(mOld, mOldPos, old, c) != ESP_OK) {
+          fail("flash read failed");
+          return false;
+        }
+        for (size_t i = 0; i < c; i++)
+          old[i] += data[i];
+        if (!output(old, c))
+          return false;
+      }
+      data += c;
+      len -= c;
+      mOldPos += c;
+      mDiffLen -= c;
+      if (!mDiffLen)
+        mState = mProduced == mNewSize ? ST_DONE : ST_EXTRA_LEN;
+      break;
+    }
+
+    case ST_DONE:
+      fail("trailing data in patch");
+      return false;
+    }
+  }
+
+  // an operation without extra or diff bytes may complete the image
+  if (mState == ST_EXTRA && !mExtraLen)
+    mState = ST_DIFF;
+  if (mState == ST_DIFF && !mDiffLen)
+    mState = mProduced == mNewSize ? ST_DONE : ST_EXTRA_LEN;
+  return true;
+}
+
+bool DeltaPatch::end()
+{
+  if (!mActive)
+    return false;
+
+  if (mState != ST_DONE) {
+    fail("truncated patch");
+    return false;
+  }
+
+  release();
+  mActive = false;
+  if (!mOta->end()) {
+    mError = mOta->error();
+    return false;
+  }
+  return true;
+}
+
+void DeltaPatch::abort()
+{
+  stop();
+  mError = NULL;
+}
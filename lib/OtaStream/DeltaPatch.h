@@ -0,0 +1,74 @@
+#ifndef __delta_patch_h__
+#define __delta_patch_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "OtaStream.h"
+
+#define DELTA_HEADER_SIZE 76
+
+struct tinfl_decompressor_tag;
+
+// Applies a patch from tools/delta_patch.py on the fly: the upload is
+// inflated, the new image rebuilt from the running partition and streamed
+// into OtaStream, which checks the embedded SHA-256 of the result.
+class DeltaPatch
+{
+  typedef enum {
+    ST_EXTRA_LEN,
+    ST_SEEK,
+    ST_DIFF_LEN,
+    ST_EXTRA,
+    ST_DIFF,
+    ST_DONE,
+  } state_t;
+
+  OtaStream *mOta;
+  const esp_partition_t *mOld;
+  tinfl_decompressor_tag *mInflator;
+  uint8_t *mDict;
+  size_t mDictPos;
+
+  uint8_t mHeader[DELTA_HEADER_SIZE];
+  size_t mHeaderLen;
+  uint32_t mNewSize;
+  uint32_t mProduced;
+
+  state_t mState;
+  uint32_t mVarint;
+  uint8_t mShift;
+  uint32_t mExtraLen;
+  int32_t mSeek;
+  uint32_t mDiffLen;
+  uint32_t mOldPos;
+
+  bool mActive;
+  const char *mError;
+
+  bool header();
+  bool inflate(const uint8_t *data, size_t len);
+  bool consume(const uint8_t *data, size_t len);
+  bool output(const uint8_t *data, size_t len);
+  void fail(const char *error);
+  void stop();
+  void release();
+
+public:
+  DeltaPatch();
+  ~DeltaPatch() { release(); }
+
+  static bool isPatch(const uint8_t *data, size_t len);
+
+  bool begin(OtaStream *ota);
+  bool write(const uint8_t *data, size_t len);
+  bool end();
+  // stop and clear any error
+  void abort();
+
+  bool active() const { return mActive; }
+  bool hasError() const { return mError != NULL; }
+  const char *error() const { return mError ? mError : ""; }
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "OtaStream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char *TAG = "ota";
+
+static int hexNibble(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+OtaStream::OtaStream()
+{
+  mHandle      = 0;
+  mPartition   = NULL;
+  mBuf         = NULL;
+  mFill        = 0;
+  mWritten     = 0;
+  mExpected    = 0;
+  mCheckDigest = false;
+  mActive      = false;
+  mError       = NULL;
+  memset(mDigest, 0, sizeof(mDigest));
+}
+
+void OtaStream::fail(const char *error)
+{
+  if (!mError)
+    mError = error;
+  ESP_LOGE(TAG, "%s", error);
+  abort();
+}
+
+bool OtaStream::begin(size_t expected, const char *sha256)
+{
+  if (mActive)
+    abort();
+
+  mFill        = 0;
+  mWritten     = 0;
+  mExpected    = expected;
+  mError       = NULL;
+  mCheckDigest = false;
+
+  if (sha256 && *sha256) {
+    if (strlen(sha256) != 64) {
+      mError = "SHA-256 must be 64 hex characters";
+      return false;
+    }
+    for (int i = 0; i < 32; i++) {
+      int hi = hexNibble(sha256[2 * i]);
+      int lo = hexNibble(sha256[2 * i + 1]);
+      if (hi < 0 || lo < 0) {
+        mError = "SHA-256 must be 64 hex characters";
+        return false;
+      }
+      mExpectedDigest[i] = (hi << 4) | lo;
+    }
+    mCheckDigest = true;
+  }
+
+  mPartition = esp_ota_get_next_update_partition(NULL);
+  if (!mPartition) {
+    mError = "no OTA partition";
+    return false;
+  }
+
+  mBuf = (uint8_t *)malloc(OTA_SECTOR_SIZE);
+  if (!mBuf) {
+    mError = "out of memory";
+    return false;
+  }
+
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+  // erase sector by sector as the image arrives, not the whole slot up front
+  esp_err_t err = esp_ota_begin(mPartition, OTA_WITH_SEQUENTIAL_WRITES, &mHandle);
+#else
+  esp_err_t err = esp_ota_begin(mPartition, OTA_SIZE_UNKNOWN, &mHandle);
+#endif
+  if (err != ESP_OK) {
+    free(mBuf);
+    mBuf   = NULL;
+    mError = esp_err_to_name(err);
+    return false;
+  }
+
+  mbedtls_sha256_init(&mSha);
+  mbedtls_sha256_starts_ret(&mSha, 0);
+  mActive = true;
+
+  ESP_LOGI(TAG, "writing to %s at 0x%x", mPartition->label,
+           mPartition->address);
+  return true;
+}
+
+bool OtaStream::flush()
+{
+  if (!mFill)
+    return true;
+
+  esp_err_t err = esp_ota_write(mHandle, mBuf, mFill);
+  if (err != ESP_OK) {
+    fail(esp_err_to_name(err));
+    return false;
+  }
+  mWritten += mFill;
+  mFill = 0;
+  return true;
+}
+
+bool OtaStream::write(const uint8_t *data, size_t len)
+{
+  if (!mActive)
+    return false;
+
+  mbedtls_sha256_update_ret(&mSha, data, len);
+
+  while (len) {
+    size_t c = OTA_SECTOR_SIZE - mFill;
+    if (c > len)
+      c = len;
+    memcpy(mBuf + mFill, data, c);
+    mFill += c;
+    data += c;
+    len -= c;
+
+    if (mFill == OTA_SECTOR_SIZE && !flush())
+      return false;
+  }
+  return true;
+}
+
+bool OtaStream::end()
+{
+  if (!mActive)
+    return false;
+  if (!flush())
+    return false;
+
+  mbedtls_sha256_finish_ret(&mSha, mDigest);
+  mbedtls_sha256_free(&mSha);
+  free(mBuf);
+  mBuf    = NULL;
+  mActive = false;
+
+  if (mCheckDigest && memcmp(mDigest, mExpectedDigest, sizeof(mDigest))) {
+    esp_ota_end(mHandle);
+    mError = "SHA-256 mismatch";
+    return false;
+  }
+
+  // checks the image header, segments and appended hash
+  esp_err_t err = esp_ota_end(mHandle);
+  if (err == ESP_OK)
+    err = esp_ota_set_boot_partition(mPartition);
+  if (err != ESP_OK) {
+    mError = err == ESP_ERR_OTA_VALIDATE_FAILED ? "invalid image"
+                                                : esp_err_to_name(err);
+    return false;
+  }
+
+  ESP_LOGI(TAG, "%u bytes written, boot from %s", mWritten, mPartition->label);
+  return true;
+}
+
+void OtaStream::abort()
+{
+  if (!mActive)
+    return;
+  mActive = false;
+  mbedtls_sha256_free(&mSha);
+  free(mBuf);
+  mBuf = NULL;
+  // releases the handle, the slot is left unselected
+  esp_ota_end(mHandle);
+}
+
+uint8_t OtaStream::progress() const
+{
+  if (!mExpected)
+    return 0;
+  size_t done = mWritten + mFill;
+  return done >= mExpected ? 100 : (uint8_t)(done * 100 / mExpected);
+}
+
+void OtaStream::digest(char hex[65])
+{
+  for (int i = 0; i < 32; i++)
+    sprintf(hex + 2 * i, "%02x", mDigest[i]);
+  hex[64] = '\0';
+}
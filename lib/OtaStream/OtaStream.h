@@ -0,0 +1,53 @@
+#ifndef __ota_stream_h__
+#define __ota_stream_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_ota_ops.h"
+#include "mbedtls/sha256.h"
+
+#define OTA_SECTOR_SIZE 4096
+
+// Firmware image writer for the inactive OTA slot.
+// Input of any chunk size is collected into whole flash sectors before it
+// hits esp_ota_write(), and hashed on the way for an optional SHA-256 check.
+class OtaStream
+{
+  esp_ota_handle_t mHandle;
+  const esp_partition_t *mPartition;
+  mbedtls_sha256_context mSha;
+  uint8_t *mBuf;
+  size_t mFill;
+  size_t mWritten;
+  size_t mExpected;
+  uint8_t mExpectedDigest[32];
+  uint8_t mDigest[32];
+  bool mCheckDigest;
+  bool mActive;
+  const char *mError;
+
+  bool flush();
+  void fail(const char *error);
+
+public:
+  OtaStream();
+  // expected: image size for progress, 0 if unknown
+  // sha256: 64 hex chars to verify against, NULL or "" to skip
+  bool begin(size_t expected, const char *sha256);
+  bool write(const uint8_t *data, size_t len);
+  // verify and select the new image for the next boot
+  bool end();
+  void abort();
+
+  bool active() const { return mActive; }
+  bool hasError() const { return mError != NULL; }
+  const char *error() const { return mError ? mError : ""; }
+  size_t written() const { return mWritten + mFill; }
+  // 0-100, 0 while the size is unknown
+  uint8_t progress() const;
+  // hex digest of everything written so far, valid after end()
+  void digest(char hex[65]);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "PageTemplate.h"
+
+#include <string.h>
+
+PageRenderer::PageRenderer(const template_page_t *page,
+                           template_render_t render)
+{
+  mPage       = page;
+  mRender     = render;
+  mSegment    = 0;
+  mOffset     = 0;
+  mItem       = 0;
+  mInVar      = false;
+  mMore       = false;
+  mPendingLen = 0;
+  mPendingPos = 0;
+}
+
+void PageRenderer::nextSegment()
+{
+  mSegment++;
+  mOffset = 0;
+  mItem   = 0;
+  mInVar  = false;
+}
+
+size_t PageRenderer::fill(uint8_t *buf, size_t size)
+{
+  size_t n = 0;
+
+  while (n < size) {
+    // finish an item that was split across responses first
+    if (mPendingPos < mPendingLen) {
+      size_t c = mPendingLen - mPendingPos;
+      if (c > size - n)
+        c = size - n;
+      memcpy(buf + n, mPending + mPendingPos, c);
+      mPendingPos += c;
+      n += c;
+      continue;
+    }
+
+    if (mSegment >= mPage->count)
+      break;
+
+    const template_segment_t *seg = &mPage->segments[mSegment];
+
+    if (!mInVar) {
+      size_t c = seg->len - mOffset;
+      if (c > size - n)
+        c = size - n;
+      memcpy(buf + n, seg->text + mOffset, c);
+      mOffset += c;
+      n += c;
+      if (mOffset == seg->len) {
+        if (seg->var == TEMPLATE_VAR_NONE)
+          nextSegment();
+        else
+          mInVar = true;
+      }
+      continue;
+    }
+
+    size_t len = 0;
+    if (size - n >= TEMPLATE_ITEM_MAX) {
+      // render straight into the response
+      mMore = mRender(seg->var, mItem, (char *)buf + n, size - n, &len);
+      n += len;
+    } else {
+      mMore = mRender(seg->var, mItem, mPending, sizeof(mPending), &len);
+      mPendingLen = len;
+      mPendingPos = 0;
+    }
+
+    if (mMore)
+      mItem++;
+    else
+      nextSegment();
+  }
+
+  return n;
+}
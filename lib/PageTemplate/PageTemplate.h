@@ -0,0 +1,52 @@
+#ifndef __page_template_h__
+#define __page_template_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TEMPLATE_VAR_NONE 0xFF
+// Largest single item a renderer may produce
+#define TEMPLATE_ITEM_MAX 160
+
+// A literal run followed by an optional placeholder, split at build time
+// by tools/build_assets.py
+typedef struct {
+  const char *text;
+  uint16_t len;
+  uint8_t var;
+} template_segment_t;
+
+typedef struct {
+  const template_segment_t *segments;
+  uint16_t count;
+} template_page_t;
+
+// Render one item of a placeholder into buf, set *len to the bytes written.
+// Return true when more items follow, e.g. one history sample per item.
+typedef bool (*template_render_t)(uint8_t var, uint32_t item, char *buf,
+                                  size_t size, size_t *len);
+
+class PageRenderer
+{
+  const template_page_t *mPage;
+  template_render_t mRender;
+  uint16_t mSegment;
+  uint16_t mOffset;
+  uint32_t mItem;
+  bool mInVar;
+  bool mMore;
+
+  // item that did not fit the response buffer, drained on the next fill()
+  char mPending[TEMPLATE_ITEM_MAX];
+  size_t mPendingLen;
+  size_t mPendingPos;
+
+  void nextSegment();
+
+public:
+  PageRenderer(const template_page_t *page, template_render_t render);
+  // AsyncWebServer chunk filler, returns 0 when the page is complete
+  size_t fill(uint8_t *buf, size_t size);
+};
+
+#endif
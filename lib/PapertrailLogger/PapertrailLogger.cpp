@@ -1,38 +1,169 @@
 #include "Arduino.h"
+#include <WiFi.h>
 #include <WiFiUdp.h>
+#include "soc/soc.h"
+
 #include "PapertrailLogger.h"
 
 const int FacilityCode = 16;
 
-PapertrailLogger::PapertrailLogger(String host, int port, LogLevel level, String color, String system, String context) {
-  mHost = host;
-  mPort = port;
-  mLevel = level;
-  mColor = color;
-  mSystem = system;
-  mContext = context;
+// Shared by all instances, the ring holds [uint16_t len][datagram] records
+static const char *logHost;
+static int logPort;
+static LogLevel threshold = Debug;
+
+static uint8_t ring[LOG_RING_SIZE];
+static size_t head = 0; // next byte to write
+static size_t tail = 0; // next byte to read
+static size_t used = 0;
+static uint32_t droppedLines = 0;
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t task = NULL;
+
+static void ringCopy(size_t *pos, uint8_t *dst, const uint8_t *src, size_t len)
+{
+  for (size_t i = 0; i < len; i++) {
+    if (dst)
+      dst[i] = ring[*pos];
+    else
+      ring[*pos] = src[i];
+    *pos = (*pos + 1) % LOG_RING_SIZE;
+  }
+}
+
+// Token bucket, called with ringMux held
+static bool rateAllows()
+{
+  static uint32_t tokens = LOG_BURST * 1000;
+  static uint32_t last   = 0;
+
+  uint32_t now           = millis();
+  tokens += (now - last) * LOG_RATE;
+  last = now;
+  if (tokens > LOG_BURST * 1000)
+    tokens = LOG_BURST * 1000;
+  if (tokens < 1000)
+    return false;
+  tokens -= 1000;
+  return true;
+}
+
+static void push(const char *msg, size_t len)
+{
+  uint16_t n = len;
+  bool wake;
+
+  portENTER_CRITICAL(&ringMux);
+  if (!rateAllows() || used + sizeof(n) + n > LOG_RING_SIZE) {
+    droppedLines++;
+    portEXIT_CRITICAL(&ringMux);
+    return;
+  }
+  ringCopy(&head, NULL, (const uint8_t *)&n, sizeof(n));
+  ringCopy(&head, NULL, (const uint8_t *)msg, n);
+  used += sizeof(n) + n;
+  wake = used > LOG_RING_SIZE / 2;
+  portEXIT_CRITICAL(&ringMux);
+
+  if (wake && task)
+    xTaskNotifyGive(task);
+}
+
+// Next datagram into buf, 0 if the ring is empty
+static size_t pop(char *buf, size_t size)
+{
+  uint16_t n = 0;
+
+  portENTER_CRITICAL(&ringMux);
+  if (used) {
+    ringCopy(&tail, (uint8_t *)&n, NULL, sizeof(n));
+    // records are never larger than the buffer they were formatted in
+    ringCopy(&tail, (uint8_t *)buf, NULL, n < size ? n : size);
+    used -= sizeof(n) + n;
+  }
+  portEXIT_CRITICAL(&ringMux);
+  return n < size ? n : size;
+}
+
+static void shipTask(void *arg)
+{
+  WiFiUDP udp;
+  IPAddress address;
+  uint32_t resolved = 0;
+  char datagram[BUFFER_SIZE + 96];
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_BATCH_MS));
+    if (!WiFi.isConnected())
+      continue;
+
+    // one DNS lookup, not one per line
+    if (!resolved || millis() - resolved > LOG_RESOLVE_MS) {
+      if (!WiFi.hostByName(logHost, address))
+        continue;
+      resolved = millis();
+    }
+
+    // RFC 5426, one message per datagram, the whole batch back to back
+    size_t len;
+    while ((len = pop(datagram, sizeof(datagram)))) {
+      udp.beginPacket(address, logPort);
+      udp.write((const uint8_t *)datagram, len);
+      if (!udp.endPacket())
+        resolved = 0;
+    }
+  }
+}
+
+PapertrailLogger::PapertrailLogger(const char *host, int port, LogLevel level,
+                                   const char *color, const char *system,
+                                   const char *context)
+{
+  mLevel     = level;
+  mColor     = color;
+  mSystem    = system;
+  mContext   = context;
   mBufferPos = 0;
-  mWifiUdp = new WiFiUDP();
-}
-
-size_t PapertrailLogger::write(uint8_t c) {
-  // check to see if we've reached the end of our buffer or received a newline character
-  if (c == '\n' || mBufferPos == BUFFER_SIZE - 1) {
-    // add a null terminating byte to the buffer
-    mBuffer[mBufferPos] = 0;
-    // construct the syslog message (see https://tools.ietf.org/html/rfc5424#page-19)
-    String syslogMessage = "<" + String(FacilityCode*8 + mLevel) + ">1 - " + mSystem + " " + mContext + " - - - " + mColor + String((const char *) mBuffer);
-    // send the syslog message to papertrail using UDP
-    mWifiUdp->beginPacket(mHost.c_str(), mPort);
-    mWifiUdp->write((const uint8_t *) syslogMessage.c_str(), syslogMessage.length());
-    mWifiUdp->endPacket();
-    // send the message to the Serial port
-    Serial.println((const char *) mBuffer);
-    mBufferPos = 0;
-  } else {
-    // buffer the character up for sending later
-    mBuffer[mBufferPos] = c;
-    mBufferPos++;
+
+  logHost    = host;
+  logPort    = port;
+  if (!task)
+    // next to the Wi-Fi stack it sends through
+    xTaskCreatePinnedToCore(shipTask, "syslog", 3072, NULL,
+                            tskIDLE_PRIORITY + 1, &task, PRO_CPU_NUM);
+}
+
+void PapertrailLogger::setLevel(LogLevel level) { threshold = level; }
+
+uint32_t PapertrailLogger::dropped() { return droppedLines; }
+
+void PapertrailLogger::sendLine()
+{
+  char datagram[BUFFER_SIZE + 96];
+
+  mBuffer[mBufferPos] = 0;
+  mBufferPos          = 0;
+  if (mLevel > threshold)
+    return;
+
+  // https://tools.ietf.org/html/rfc5424#page-19
+  int n = snprintf(datagram, sizeof(datagram), "<%d>1 - %s %s - - - %s%s",
+                   FacilityCode * 8 + mLevel, mSystem, mContext, mColor,
+                   mBuffer);
+  if (n > 0)
+    push(datagram, n < (int)sizeof(datagram) ? n : sizeof(datagram) - 1);
+}
+
+size_t PapertrailLogger::write(uint8_t c)
+{
+  if (c == '\n') {
+    sendLine();
+    return 1;
   }
+  // a full buffer goes out as its own line
+  if (mBufferPos == BUFFER_SIZE - 1)
+    sendLine();
+  mBuffer[mBufferPos++] = c;
   return 1;
 }
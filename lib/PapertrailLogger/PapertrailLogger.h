@@ -1,7 +1,7 @@
 #ifndef __papertrail_logger_h__
 #define __papertrail_logger_h__
 
-class WiFiUDP;
+#include <Print.h>
 
 enum LogLevel {
   Error = 3,
@@ -11,24 +11,39 @@ enum LogLevel {
   Debug = 7
 };
 
-#define BUFFER_SIZE 200
+#define BUFFER_SIZE    200  // longest message, longer lines are split
+#define LOG_RING_SIZE  2048 // formatted datagrams waiting for the task
+#define LOG_BATCH_MS   500  // the task drains the ring this often
+#define LOG_RATE       10   // lines per second on average
+#define LOG_BURST      20   // lines at once before the rate applies
+#define LOG_RESOLVE_MS (60 * 60 * 1000L) // re-resolve the host this often
 
-class PapertrailLogger: public Print  {
+// Syslog (RFC 5424) over UDP. Lines are formatted into a shared ring
+// without allocating and shipped in batches by a low priority task that
+// keeps the resolved address, so logging never blocks on the network.
+// Every instance logs with its own level, all of them share the host.
+class PapertrailLogger : public Print
+{
   private:
-    String mHost;
-    int mPort;
-    WiFiUDP *mWifiUdp;
-    LogLevel mLevel;
-    String mSystem;
-    String mContext;
-    String mColor;
-
-    uint8_t mBuffer[BUFFER_SIZE];
-    int mBufferPos;
-    
+  LogLevel mLevel;
+  const char *mSystem;
+  const char *mContext;
+  const char *mColor;
+
+  char mBuffer[BUFFER_SIZE];
+  int mBufferPos;
+
+  void sendLine();
+
   public:
-    PapertrailLogger(String host, int port, LogLevel level, String color, String system, String context);
-    size_t write(uint8_t c);
+  PapertrailLogger(const char *host, int port, LogLevel level,
+                   const char *color, const char *system, const char *context);
+  size_t write(uint8_t c);
+
+  // Lines less severe than level are dropped, for all instances
+  static void setLevel(LogLevel level);
+  // Lines lost to the rate limit or a full ring
+  static uint32_t dropped();
 };
 
 #endif
@@ -0,0 +1,75 @@
+#include "PowerSave.h"
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "esp_pm.h"
+#include "esp_timer.h"
+
+static bool standby      = false;
+static bool lightSleep   = false;
+static int64_t since     = 0; // us, start of the current mode
+static int64_t standbyUs = 0; // us in standby before the current mode
+
+static bool pmConfigure(bool sleep)
+{
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t pm;
+  pm.max_freq_mhz = sleep ? 80 : 240;
+  pm.min_freq_mhz = sleep ? 40 : 240;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  pm.light_sleep_enable = sleep;
+#else
+  pm.light_sleep_enable = false;
+#endif
+  if (esp_pm_configure(&pm) == ESP_OK)
+    return sleep && pm.light_sleep_enable;
+#endif
+  // no power management in this build, fixed frequency instead
+  setCpuFrequencyMhz(sleep ? 80 : 240);
+  return false;
+}
+
+bool powerStandby(bool on)
+{
+  if (on == standby)
+    return false;
+
+  int64_t now = esp_timer_get_time();
+  if (standby)
+    standbyUs += now - since;
+  since   = now;
+  standby = on;
+
+  // kept on wake, it describes what standby does in this build
+  bool slept = pmConfigure(on);
+  if (on)
+    lightSleep = slept;
+  // max modem sleep skips DTIM beacons, replies take a few 100 ms longer
+  WiFi.setSleep(on ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+  return true;
+}
+
+bool powerInStandby() { return standby; }
+
+bool powerLightSleep() { return lightSleep; }
+
+uint32_t powerStandbySeconds()
+{
+  int64_t us = standbyUs;
+  if (standby)
+    us += esp_timer_get_time() - since;
+  return us / 1000000;
+}
+
+float powerCurrent()
+{
+  float total = esp_timer_get_time() / 1e6f;
+  if (total <= 0)
+    return POWER_MA_ACTIVE;
+
+  // whether standby light sleeps depends on the build, not on the time
+  float idle = powerStandbySeconds();
+  float ma   = lightSleep ? POWER_MA_LIGHT_SLEEP : POWER_MA_IDLE;
+  return (POWER_MA_ACTIVE * (total - idle) + ma * idle) / total;
+}
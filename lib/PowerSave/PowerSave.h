@@ -0,0 +1,29 @@
+#ifndef __power_save_h__
+#define __power_save_h__
+
+#include <stdint.h>
+
+// Standby between firings: CPU down to 80 MHz, Wi-Fi modem sleep with the
+// maximum listen interval and, when the IDF build has power management
+// with tickless idle, automatic light sleep. Timers still run, so Tickers,
+// the safety task and MQTT keep working, only slower to respond.
+
+// Typical ESP32-WROOM draw per mode, mA, from the datasheet
+#define POWER_MA_ACTIVE      68 // 240 MHz, Wi-Fi modem sleep (DTIM 1)
+#define POWER_MA_IDLE        22 // 80 MHz, Wi-Fi max modem sleep
+#define POWER_MA_LIGHT_SLEEP 3  // auto light sleep between DTIM wake-ups
+
+// true when the mode changed
+bool powerStandby(bool standby);
+bool powerInStandby();
+// Whether standby can light sleep, needs CONFIG_PM_ENABLE and
+// CONFIG_FREERTOS_USE_TICKLESS_IDLE
+bool powerLightSleep();
+
+// Estimated average draw since boot from the time spent in each mode, the
+// board has no current sensor
+float powerCurrent();
+// s spent in standby since boot
+uint32_t powerStandbySeconds();
+
+#endif // __power_save_h__
@@ -0,0 +1,75 @@
+#include "Settings.h"
+
+#include <Preferences.h>
+
+static const char *NAMESPACE = "settings";
+static const char *KEY       = "blob";
+
+// stored blobs are never expected to outgrow this
+#define SETTINGS_MAX_SIZE 512
+
+// sizeof(settings_t) of each version, a blob must match its own entry
+static constexpr uint16_t SETTINGS_SIZES[SETTINGS_VERSION + 1] = {0, 230};
+static_assert(sizeof(settings_t) == SETTINGS_SIZES[SETTINGS_VERSION],
+              "settings_t changed, bump SETTINGS_VERSION and SETTINGS_SIZES");
+
+void settingsDefaults(settings_t *s)
+{
+  memset(s, 0, sizeof(*s));
+  s->version = SETTINGS_VERSION;
+  s->size    = sizeof(*s);
+  SETTINGS_SET(s->hostname, "toilet");
+  SETTINGS_SET(s->mqttServer, "io.adafruit.com");
+  s->mqttPort = SETTINGS_DEFAULT_PORT;
+}
+
+bool settingsLoad(settings_t *s)
+{
+  uint8_t blob[SETTINGS_MAX_SIZE];
+  Preferences prefs;
+
+  settingsDefaults(s);
+
+  if (!prefs.begin(NAMESPACE, true))
+    return false;
+  size_t len = prefs.getBytes(KEY, blob, sizeof(blob));
+  prefs.end();
+
+  uint16_t version, size;
+  if (len < sizeof(version) + sizeof(size))
+    return false;
+  memcpy(&version, blob, sizeof(version));
+  memcpy(&size, blob + sizeof(version), sizeof(size));
+
+  // written by a newer firmware, don't guess its layout
+  if (version == 0 || version > SETTINGS_VERSION)
+    return false;
+  // a length that does not fit the version is a torn or foreign blob
+  if (size != len || size != SETTINGS_SIZES[version])
+    return false;
+
+  // layouts only grow, fields past an older blob keep their defaults
+  memcpy(s, blob, size);
+
+  s->version = SETTINGS_VERSION;
+  s->size    = sizeof(*s);
+  s->hostname[sizeof(s->hostname) - 1]     = '\0';
+  s->mqttServer[sizeof(s->mqttServer) - 1] = '\0';
+  s->mqttUser[sizeof(s->mqttUser) - 1]     = '\0';
+  s->mqttPass[sizeof(s->mqttPass) - 1]     = '\0';
+  return true;
+}
+
+bool settingsSave(settings_t *s)
+{
+  Preferences prefs;
+
+  s->version = SETTINGS_VERSION;
+  s->size    = sizeof(*s);
+
+  if (!prefs.begin(NAMESPACE, false))
+    return false;
+  bool ok = prefs.putBytes(KEY, s, sizeof(*s)) == sizeof(*s);
+  prefs.end();
+  return ok;
+}
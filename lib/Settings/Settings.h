@@ -0,0 +1,33 @@
+#ifndef __settings_h__
+#define __settings_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Bump when settings_t changes and add its size to SETTINGS_SIZES in
+// Settings.cpp. New fields go at the end, settingsLoad() keeps the stored
+// size of an older blob and fills the rest from settingsDefaults().
+#define SETTINGS_VERSION 1
+
+#define SETTINGS_DEFAULT_PORT 1883 // MQTT, also for an empty or 0 port
+
+typedef struct {
+  uint16_t version;
+  uint16_t size;
+  char hostname[32];
+  char mqttServer[64];
+  uint16_t mqttPort;
+  char mqttUser[64];
+  char mqttPass[64];
+} settings_t;
+
+// Copy a string field, truncated to fit and always terminated
+#define SETTINGS_SET(field, value) strlcpy(field, value, sizeof(field))
+
+void settingsDefaults(settings_t *s);
+// One NVS read, false when nothing valid is stored and s holds defaults
+bool settingsLoad(settings_t *s);
+bool settingsSave(settings_t *s);
+
+#endif
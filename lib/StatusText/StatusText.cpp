@@ -0,0 +1,94 @@
+#include "StatusText.h"
+
+static size_t clamp(int n, size_t size)
+{
+  if (n < 0 || !size)
+    return 0;
+  return (size_t)n < size ? n : size - 1;
+}
+
+size_t statusStart(char *buf, size_t size, const Zone &z)
+{
+  int n = snprintf(buf, size, "Flushing 🔥 @%d C", z.segments[z.step][0]);
+  return clamp(n, size);
+}
+
+size_t statusStartLcd(char *buf, size_t size, const Zone &z)
+{
+  int n = snprintf(buf, size, "Flushing: %d C %s", z.segments[z.step][0],
+                   z.segments[0][2] > 15 ? "Poo" : "Pee");
+  return clamp(n, size);
+}
+
+size_t statusInfo(char *buf, size_t size, const Zone &z, zone_event_t e,
+                  uint32_t now)
+{
+  int n = 0;
+
+  switch (e) {
+  case ZONE_EVENT_HOLD_START:
+  case ZONE_EVENT_HOLDING:
+    n = snprintf(buf, size, "Hold: %.0f°C-%u/%dmin", z.setpoint,
+                 (unsigned)((now - z.holdMillis) / (60 * 1000)),
+                 z.segments[z.step][2]);
+    break;
+  case ZONE_EVENT_STEP:
+    n = snprintf(buf, size, "Flushing 🔥 @%d°C", z.segments[z.step][0]);
+    break;
+  case ZONE_EVENT_SLOW_COOL:
+    n = snprintf(buf, size, "Slow Cooling ❄️");
+    break;
+  case ZONE_EVENT_COOLING:
+    n = snprintf(buf, size, "Cooling ❄️");
+    break;
+  default:
+    break;
+  }
+  return clamp(n, size);
+}
+
+size_t statusLcd(char *buf, size_t size, const Zone &z, zone_event_t e)
+{
+  int n = 0;
+
+  switch (e) {
+  case ZONE_EVENT_HOLD_START:
+    n = snprintf(buf, size, "Burning: %dmin", z.segments[z.step][2]);
+    break;
+  case ZONE_EVENT_COOLING:
+    n = snprintf(buf, size, "Cooling");
+    break;
+  default:
+    break;
+  }
+  return clamp(n, size);
+}
+
+size_t statusNotify(char *buf, size_t size, const char *host, const char *msg,
+                    size_t len)
+{
+  int n = snprintf(buf, size, "%s - %.*s", host, (int)len, msg);
+  return clamp(n, size);
+}
+
+size_t htmlEscape(char *buf, size_t size, const char *str)
+{
+  size_t n = 0;
+  for (; *str && n + 7 < size; str++) {
+    switch (*str) {
+    case '"':
+      n += snprintf(buf + n, size - n, "&quot;");
+      break;
+    case '&':
+      n += snprintf(buf + n, size - n, "&amp;");
+      break;
+    case '<':
+      n += snprintf(buf + n, size - n, "&lt;");
+      break;
+    default:
+      buf[n++] = *str;
+    }
+  }
+  buf[n] = '\0';
+  return n;
+}
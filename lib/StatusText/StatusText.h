@@ -0,0 +1,71 @@
+#ifndef __status_text_h__
+#define __status_text_h__
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "Zone.h"
+
+// Runtime text for the web display, the LCD and the graph. Everything is
+// formatted into caller buffers, weeks of firings never touch the heap.
+
+// Status line when a program starts
+size_t statusStart(char *buf, size_t size, const Zone &z);
+// LCD line when a program starts
+size_t statusStartLcd(char *buf, size_t size, const Zone &z);
+// Status line after a zone event, 0 if the event changes nothing shown
+size_t statusInfo(char *buf, size_t size, const Zone &z, zone_event_t e,
+                  uint32_t now);
+// LCD line after a zone event, 0 if the event changes nothing shown
+size_t statusLcd(char *buf, size_t size, const Zone &z, zone_event_t e);
+// "<host> - <msg>" for notify(), msg need not be terminated
+size_t statusNotify(char *buf, size_t size, const char *host, const char *msg,
+                    size_t len);
+// Text for an HTML attribute value
+size_t htmlEscape(char *buf, size_t size, const char *str);
+
+// Temperature history of the last N samples, the count keeps going once
+// the oldest are overwritten. Whole degrees are all the graph shows, kept
+// as integers they take half the RAM and print without float formatting.
+template <size_t N> class GraphRing
+{
+  int16_t mTemps[N];  // degC
+  uint32_t mTimes[N]; // uptime s of each sample
+  uint32_t mCount;
+
+public:
+  GraphRing() : mCount(0) {}
+
+  void add(uint32_t uptime, float temp)
+  {
+    mTimes[mCount % N] = uptime;
+    mTemps[mCount % N] = (int16_t)lroundf(temp);
+    mCount++;
+  }
+  uint32_t count() const { return mCount; }
+
+  // One [epoch,degC] pair per item, oldest first, for a streamed JSON array.
+  // offset is epoch - uptime, 0 before the clock is set holds the history
+  // back. Returns true while items follow, like a template variable.
+  bool fill(uint32_t item, time_t offset, char *buf, size_t size,
+            size_t *len) const
+  {
+    uint32_t count = offset ? (mCount < N ? mCount : N) : 0;
+    int n;
+    if (item >= count) {
+      n    = snprintf(buf, size, item ? "]" : "[]");
+      *len = n < 0 ? 0 : (size_t)n < size ? n : size - 1;
+      return false;
+    }
+    uint32_t i = (mCount - count + item) % N;
+    n = snprintf(buf, size, "%c[%ld,%d]", item ? ',' : '[',
+                 (long)(offset + mTimes[i]), mTemps[i]);
+    *len = n < 0 ? 0 : (size_t)n < size ? n : size - 1;
+    return true;
+  }
+};
+
+#endif // __status_text_h__
@@ -0,0 +1,258 @@
+#include "Telemetry.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+TelemetryWriter::TelemetryWriter(uint8_t *buf, size_t size)
+{
+  mBuf      = buf;
+  mSize     = size;
+  mPos      = 0;
+  mOverflow = false;
+}
+
+void TelemetryWriter::put(uint8_t c)
+{
+  if (mPos < mSize)
+    mBuf[mPos++] = c;
+  else
+    mOverflow = true;
+}
+
+void TelemetryWriter::put(const void *data, size_t len)
+{
+  if (mPos + len <= mSize) {
+    memcpy(mBuf + mPos, data, len);
+    mPos += len;
+  } else
+    mOverflow = true;
+}
+
+/* JSON */
+
+JsonWriter::JsonWriter(uint8_t *buf, size_t size) : TelemetryWriter(buf, size)
+{
+  mCount[0] = 0;
+  mCount[1] = 0;
+  mDepth    = 0;
+}
+
+void JsonWriter::separator()
+{
+  if (mDepth && mCount[mDepth - 1]++)
+    put(',');
+}
+
+void JsonWriter::beginMap(uint8_t)
+{
+  put('{');
+  if (mDepth < sizeof(mCount))
+    mCount[mDepth++] = 0;
+}
+
+void JsonWriter::endMap()
+{
+  put('}');
+  if (mDepth)
+    mDepth--;
+}
+
+void JsonWriter::key(const char *k, size_t len)
+{
+  separator();
+  put('"');
+  put(k, len);
+  put('"');
+  put(':');
+}
+
+void JsonWriter::value(float v)
+{
+  if (!isfinite(v)) {
+    put("null", 4);
+    return;
+  }
+
+  char s[24];
+  int n = snprintf(s, sizeof(s), "%.3f", v);
+  // trim trailing zeros, "21.250" -> "21.25", "3.000" -> "3"
+  while (n > 1 && s[n - 1] == '0')
+    n--;
+  if (s[n - 1] == '.')
+    n--;
+  put(s, n);
+}
+
+void JsonWriter::value(uint32_t v)
+{
+  char s[12];
+  put(s, snprintf(s, sizeof(s), "%u", (unsigned)v));
+}
+
+void JsonWriter::value(int32_t v)
+{
+  char s[12];
+  put(s, snprintf(s, sizeof(s), "%d", (int)v));
+}
+
+size_t JsonWriter::finish()
+{
+  // null terminate for logging, not part of the payload
+  if (mPos < mSize)
+    mBuf[mPos] = '\0';
+  return length();
+}
+
+/* CBOR, RFC 8949 */
+
+void CborWriter::head(uint8_t major, uint32_t v)
+{
+  major <<= 5;
+  if (v < 24) {
+    put((uint8_t)(major | v));
+  } else if (v <= 0xFF) {
+    put((uint8_t)(major | 24));
+    put((uint8_t)v);
+  } else if (v <= 0xFFFF) {
+    put((uint8_t)(major | 25));
+    put((uint8_t)(v >> 8));
+    put((uint8_t)v);
+  } else {
+    put((uint8_t)(major | 26));
+    put((uint8_t)(v >> 24));
+    put((uint8_t)(v >> 16));
+    put((uint8_t)(v >> 8));
+    put((uint8_t)v);
+  }
+}
+
+void CborWriter::key(const char *k, size_t len)
+{
+  head(3, len);
+  put(k, len);
+}
+
+void CborWriter::value(float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  put(0xFA);
+  put((uint8_t)(bits >> 24));
+  put((uint8_t)(bits >> 16));
+  put((uint8_t)(bits >> 8));
+  put((uint8_t)bits);
+}
+
+void CborWriter::value(int32_t v)
+{
+  if (v < 0)
+    head(1, (uint32_t)(-1 - v));
+  else
+    head(0, (uint32_t)v);
+}
+
+/* MessagePack */
+
+void MsgPackWriter::beginMap(uint8_t n)
+{
+  // fixmap holds 15 pairs, map16 the rest
+  if (n <= 0x0F) {
+    put((uint8_t)(0x80 | n));
+  } else {
+    put(0xDE);
+    put((uint8_t)0);
+    put(n);
+  }
+}
+
+void MsgPackWriter::key(const char *k, size_t len)
+{
+  // all keys are short, fixstr
+  put((uint8_t)(0xA0 | (len & 0x1F)));
+  put(k, len);
+}
+
+void MsgPackWriter::value(float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  put(0xCA);
+  put((uint8_t)(bits >> 24));
+  put((uint8_t)(bits >> 16));
+  put((uint8_t)(bits >> 8));
+  put((uint8_t)bits);
+}
+
+void MsgPackWriter::value(uint32_t v)
+{
+  if (v < 0x80) {
+    put((uint8_t)v);
+  } else if (v <= 0xFF) {
+    put(0xCC);
+    put((uint8_t)v);
+  } else if (v <= 0xFFFF) {
+    put(0xCD);
+    put((uint8_t)(v >> 8));
+    put((uint8_t)v);
+  } else {
+    put(0xCE);
+    put((uint8_t)(v >> 24));
+    put((uint8_t)(v >> 16));
+    put((uint8_t)(v >> 8));
+    put((uint8_t)v);
+  }
+}
+
+void MsgPackWriter::value(int32_t v)
+{
+  if (v >= 0) {
+    value((uint32_t)v);
+  } else if (v >= -32) {
+    put((uint8_t)v); // negative fixint
+  } else if (v >= -128) {
+    put(0xD0);
+    put((uint8_t)v);
+  } else if (v >= -32768) {
+    put(0xD1);
+    put((uint8_t)(v >> 8));
+    put((uint8_t)v);
+  } else {
+    put(0xD2);
+    put((uint8_t)(v >> 24));
+    put((uint8_t)(v >> 16));
+    put((uint8_t)(v >> 8));
+    put((uint8_t)v);
+  }
+}
+
+size_t telemetryEncode(const telemetry_t &t, telemetry_format_t format,
+                       uint8_t *buf, size_t size)
+{
+  switch (format) {
+  case TELEMETRY_CBOR: {
+    CborWriter w(buf, size);
+    return telemetryEncode(t, w);
+  }
+  case TELEMETRY_MSGPACK: {
+    MsgPackWriter w(buf, size);
+    return telemetryEncode(t, w);
+  }
+  default: {
+    JsonWriter w(buf, size);
+    return telemetryEncode(t, w);
+  }
+  }
+}
+
+const char *telemetrySuffix(telemetry_format_t format)
+{
+  switch (format) {
+  case TELEMETRY_CBOR:
+    return "cbor";
+  case TELEMETRY_MSGPACK:
+    return "msgpack";
+  default:
+    return "json";
+  }
+}
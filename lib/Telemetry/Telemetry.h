@@ -0,0 +1,125 @@
+#ifndef __telemetry_h__
+#define __telemetry_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Telemetry record published every sendData(), declared once.
+// F(member, key, type) - key is the wire name, kept short on purpose.
+#define TELEMETRY_FIELDS(F)                                                    \
+  F(temp, "T", float)                                                          \
+  F(current, "I", float)                                                       \
+  F(power, "P", float)                                                         \
+  F(energy, "E", uint32_t)                                                     \
+  F(cost, "$", float)                                                          \
+  F(tInt, "Tint", float)                                                       \
+  F(setpoint, "St", float)                                                     \
+  F(step, "Step", int32_t)                                                     \
+  F(rssi, "RSSI", int32_t)                                                     \
+  F(eta, "ETA", uint32_t)                                                      \
+  F(curtail, "Cut", uint32_t)
+
+#define TELEMETRY_MEMBER(member, key, type) type member;
+#define TELEMETRY_COUNT(member, key, type) +1
+
+typedef struct {
+  TELEMETRY_FIELDS(TELEMETRY_MEMBER)
+} telemetry_t;
+
+const uint8_t TELEMETRY_FIELD_COUNT = 0 TELEMETRY_FIELDS(TELEMETRY_COUNT);
+
+typedef enum {
+  TELEMETRY_JSON,
+  TELEMETRY_CBOR,
+  TELEMETRY_MSGPACK,
+} telemetry_format_t;
+
+// Writes into a caller supplied buffer, never allocates.
+// All writers share the same interface so the encoder below is generated once.
+class TelemetryWriter
+{
+protected:
+  uint8_t *mBuf;
+  size_t mSize;
+  size_t mPos;
+  bool mOverflow;
+
+  void put(uint8_t c);
+  void put(const void *data, size_t len);
+
+public:
+  TelemetryWriter(uint8_t *buf, size_t size);
+  // Encoded length, 0 when the buffer was too small
+  size_t length() const { return mOverflow ? 0 : mPos; }
+};
+
+class JsonWriter : public TelemetryWriter
+{
+  uint8_t mCount[2];
+  uint8_t mDepth;
+
+  void separator();
+
+public:
+  JsonWriter(uint8_t *buf, size_t size);
+  void beginMap(uint8_t n);
+  void endMap();
+  void key(const char *k, size_t len);
+  void value(float v);
+  void value(uint32_t v);
+  void value(int32_t v);
+  size_t finish();
+};
+
+class CborWriter : public TelemetryWriter
+{
+  void head(uint8_t major, uint32_t v);
+
+public:
+  CborWriter(uint8_t *buf, size_t size) : TelemetryWriter(buf, size) {}
+  void beginMap(uint8_t n) { head(5, n); }
+  void endMap() {}
+  void key(const char *k, size_t len);
+  void value(float v);
+  void value(uint32_t v) { head(0, v); }
+  void value(int32_t v);
+  size_t finish() { return length(); }
+};
+
+class MsgPackWriter : public TelemetryWriter
+{
+public:
+  MsgPackWriter(uint8_t *buf, size_t size) : TelemetryWriter(buf, size) {}
+  void beginMap(uint8_t n);
+  void endMap() {}
+  void key(const char *k, size_t len);
+  void value(float v);
+  void value(uint32_t v);
+  void value(int32_t v);
+  size_t finish() { return length(); }
+};
+
+// {"feeds":{"T":..,"I":..}} - same layout the ArduinoJson document used
+template <class W> size_t telemetryEncode(const telemetry_t &t, W &w)
+{
+#define TELEMETRY_ENCODE(member, k, type)                                      \
+  w.key(k, sizeof(k) - 1);                                                     \
+  w.value(t.member);
+
+  w.beginMap(1);
+  w.key("feeds", 5);
+  w.beginMap(TELEMETRY_FIELD_COUNT);
+  TELEMETRY_FIELDS(TELEMETRY_ENCODE)
+  w.endMap();
+  w.endMap();
+  return w.finish();
+
+#undef TELEMETRY_ENCODE
+}
+
+size_t telemetryEncode(const telemetry_t &t, telemetry_format_t format,
+                       uint8_t *buf, size_t size);
+
+const char *telemetrySuffix(telemetry_format_t format);
+
+#endif
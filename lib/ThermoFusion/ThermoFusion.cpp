@@ -0,0 +1,98 @@
+#include "ThermoFusion.h"
+
+#include <math.h>
+
+#define FUSION_ALPHA     0.02f // per FUSION_PERIOD, ~12 s
+#define FUSION_NOISE     2.0f  // degC mean step that halves the score
+#define FUSION_DISAGREE  25.0f // degC between probes
+#define FUSION_CJ_SPREAD 10.0f // degC between cold junctions on one board
+#define FUSION_CJ_MIN    -20.0f
+#define FUSION_CJ_MAX    85.0f
+#define FUSION_HEALTHY   0.5f
+#define FUSION_SCG_COST  0.25f // a short to GND still reads, counts less
+
+static void ewma(float *avg, float sample, float alpha)
+{
+  *avg += alpha * (sample - *avg);
+}
+
+static bool usable(const probe_sample_t &s)
+{
+  return !(s.error & (PROBE_OC | PROBE_SCV)) && !isnan(s.temp);
+}
+
+void ProbeHealth::reset()
+{
+  mLast         = NAN;
+  mFaults       = 0;
+  mNoise        = 0;
+  mDisagree     = 0;
+  mColdJunction = 0;
+  mValid        = false;
+}
+
+void ProbeHealth::update(const probe_sample_t &s, const probe_sample_t *other,
+                         uint32_t ms)
+{
+  // same time constant whatever the sample rate
+  float alpha = fminf(FUSION_ALPHA * ms / FUSION_PERIOD, 1);
+  mValid      = usable(s);
+
+  ewma(&mFaults, !mValid ? 1 : (s.error & PROBE_SCG) ? FUSION_SCG_COST : 0,
+       alpha);
+
+  bool cjBad = isnan(s.tInt) || s.tInt < FUSION_CJ_MIN || s.tInt > FUSION_CJ_MAX;
+  if (other && usable(*other) && !cjBad && !isnan(other->tInt))
+    cjBad = fabsf(s.tInt - other->tInt) > FUSION_CJ_SPREAD;
+  ewma(&mColdJunction, cjBad, alpha);
+
+  if (!mValid)
+    return;
+
+  if (!isnan(mLast))
+    ewma(&mNoise, fabsf(s.temp - mLast), alpha);
+  mLast = s.temp;
+
+  if (other && usable(*other))
+    ewma(&mDisagree, fabsf(s.temp - other->temp) > FUSION_DISAGREE, alpha);
+}
+
+float ProbeHealth::score() const
+{
+  return (1 - mFaults) * (1 / (1 + mNoise / FUSION_NOISE)) *
+         (1 - 0.5f * mDisagree) * (1 - mColdJunction);
+}
+
+bool ProbeHealth::healthy() const { return mValid && score() > FUSION_HEALTHY; }
+
+int thermoFuse(const probe_sample_t *s, const ProbeHealth *h, uint8_t n,
+               probe_sample_t *out)
+{
+  int best = -1;
+  for (uint8_t i = 0; i < n; i++) {
+    if (h[i].valid() && (best < 0 || h[i].score() > h[best].score()))
+      best = i;
+  }
+
+  if (best < 0) {
+    *out = s[0];
+    return -1;
+  }
+
+  // average the probes that agree with the best one, weighted by health
+  float w    = 0;
+  float temp = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    if (!h[i].valid() || fabsf(s[i].temp - s[best].temp) > FUSION_DISAGREE)
+      continue;
+    // a zero score still counts a little so a lone probe is never dropped
+    float wi = h[i].score() + 1e-3f;
+    temp += wi * s[i].temp;
+    w += wi;
+  }
+
+  out->temp  = temp / w;
+  out->tInt  = s[best].tInt;
+  out->error = s[best].error;
+  return best;
+}
@@ -0,0 +1,50 @@
+#ifndef __thermo_fusion_h__
+#define __thermo_fusion_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MAX31855 fault bits
+#define PROBE_OC  0b001 // open circuit
+#define PROBE_SCG 0b010 // short to GND, spurious with grounded probes
+#define PROBE_SCV 0b100 // short to VCC
+
+#define FUSION_PERIOD 250 // ms, nominal time between update() calls
+
+typedef struct {
+  float temp;
+  float tInt; // cold junction
+  uint8_t error;
+} probe_sample_t;
+
+// Rolling health of one probe in [0, 1] from its fault rate, sample to
+// sample noise, disagreement with the other probe and a sane cold junction
+class ProbeHealth
+{
+  float mLast;
+  float mFaults;
+  float mNoise;
+  float mDisagree;
+  float mColdJunction;
+  bool mValid; // latest sample has a usable temperature
+
+public:
+  ProbeHealth() { reset(); }
+
+  void reset();
+  // other is the other probe's sample or NULL with a single probe, ms the
+  // time since the previous sample
+  void update(const probe_sample_t &s, const probe_sample_t *other,
+              uint32_t ms = FUSION_PERIOD);
+  float score() const;
+  bool valid() const { return mValid; }
+  bool healthy() const;
+};
+
+// Fused reading of n probes, agreeing probes are averaged by score,
+// otherwise the healthiest one wins. Returns the index of the probe in
+// charge, -1 with out->error set when none has a usable sample.
+int thermoFuse(const probe_sample_t *s, const ProbeHealth *h, uint8_t n,
+               probe_sample_t *out);
+
+#endif // __thermo_fusion_h__
@@ -0,0 +1,28 @@
+#include "TimeService.h"
+
+#include <Arduino.h>
+
+#include "esp_sntp.h"
+#include "esp_timer.h"
+
+// epoch - uptime in seconds, written by the SNTP task only
+static volatile time_t offset = 0;
+
+static void onSync(struct timeval *tv)
+{
+  // same instant on both clocks, rounding to the second happens once here
+  int64_t us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+  offset     = (us - esp_timer_get_time()) / 1000000;
+}
+
+void timeBegin(const char *tz, const char *server1, const char *server2)
+{
+  sntp_set_time_sync_notification_cb(onSync);
+  configTzTime(tz, server1, server2);
+}
+
+bool timeSynced() { return offset != 0; }
+
+uint32_t timeUptime() { return esp_timer_get_time() / 1000000; }
+
+time_t timeEpoch(uint32_t uptime) { return offset ? offset + uptime : 0; }
@@ -0,0 +1,22 @@
+#ifndef __time_service_h__
+#define __time_service_h__
+
+#include <stdint.h>
+#include <time.h>
+
+// Timestamps on the monotonic esp_timer clock, converted to the epoch with
+// one add once SNTP has synced. Samples taken before the sync get their
+// wall time as soon as it arrives, nothing is skipped or rewritten.
+
+// Starts SNTP with a POSIX TZ string, see configTzTime()
+void timeBegin(const char *tz, const char *server1, const char *server2);
+
+bool timeSynced();
+
+// Seconds since boot, never jumps
+uint32_t timeUptime();
+
+// Unix time of a timeUptime() stamp, 0 before the first sync
+time_t timeEpoch(uint32_t uptime);
+
+#endif // __time_service_h__
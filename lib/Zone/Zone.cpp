@@ -0,0 +1,218 @@
+#include "Zone.h"
+
+#include <math.h>
+#include <string.h>
+
+Zone::Zone(uint8_t pin, uint16_t watts)
+    : mPhase(ZONE_IDLE), mDiff(0), mHoldFraction(0), mDemand(false),
+      mDuty(1), mSlot(0), mLast(0), mPreheat(0), step(0), setpoint(0),
+      initMillis(0), holdMillis(0), pin(pin), watts(watts), relay(false)
+{
+  memset(segments, 0, sizeof(segments));
+}
+
+void Zone::start(float temp, uint32_t now)
+{
+  // guess the step, past a target its ramp is done
+  step = 0;
+  if (temp > segments[2][0])
+    step = 3;
+  else if (temp > segments[1][0])
+    step = 2;
+  else if (temp > segments[0][0])
+    step = 1;
+
+  // empty parameters (toilet)
+  if (segments[3][0] == 0)
+    step = 0;
+
+  mPhase     = ZONE_RAMP;
+  mDiff      = 0;
+  mDemand    = false;
+  mPreheat   = 0;
+  initMillis = now;
+  holdMillis = 0;
+  setpoint   = temp;
+  rate();
+}
+
+zone_event_t Zone::hold(uint32_t now)
+{
+  uint32_t minutes = segments[step][2];
+  zone_event_t e   = ZONE_EVENT_HOLDING;
+
+  if (holdMillis == 0) {
+    holdMillis = now;
+    mPhase     = ZONE_HOLD;
+    e          = ZONE_EVENT_HOLD_START;
+  }
+
+  uint32_t elapsed = (now - holdMillis) / (60 * 1000);
+  mHoldFraction    = minutes ? (float)elapsed / minutes : 1;
+  if (elapsed < minutes)
+    return e;
+
+  step++;
+  holdMillis    = 0;
+  mHoldFraction = 0;
+  mPhase        = ZONE_RAMP;
+  return ZONE_EVENT_STEP;
+}
+
+zone_event_t Zone::control(float temp, uint32_t now)
+{
+  uint32_t dt = mLast ? now - mLast : 0;
+  mLast       = now;
+
+  if (isnan(temp) || !active()) {
+    mDemand = false;
+    return ZONE_EVENT_NONE;
+  }
+
+  // a curtailed hold that cannot keep its temperature is paused
+  if (mPhase == ZONE_HOLD && mDuty < 1 && temp < setpoint - ZONE_DIFFERENTIAL)
+    holdMillis += dt;
+  if (mPhase == ZONE_RAMP && step == 0)
+    mPreheat += dt * mDuty;
+
+  // heat below setpoint - differential, then up to the setpoint
+  if (setpoint - temp - mDiff >= 0) {
+    if (!mDemand)
+      mDiff = 0;
+    mDemand = true;
+  } else if (mDemand) {
+    mDemand = false;
+    mDiff   = ZONE_DIFFERENTIAL;
+  }
+
+  if (mPhase == ZONE_SLOW_COOL)
+    return ZONE_EVENT_NONE;
+
+  zone_event_t e = ZONE_EVENT_NONE;
+  if (step < ZONE_SEGMENTS && temp > segments[step][0]) {
+    setpoint = segments[step][0];
+
+    if (segments[step][2] == -1)
+      segments[step][2] = 0;
+    e = hold(now);
+  }
+
+  if (step >= ZONE_SEGMENTS) {
+    step   = ZONE_DONE;
+    mPhase = ZONE_SLOW_COOL;
+    e      = ZONE_EVENT_SLOW_COOL;
+  }
+  return e;
+}
+
+zone_event_t Zone::rate()
+{
+  // http://www.stoneware.net/stoneware/glasyrer/firing.htm
+  if (mPhase == ZONE_RAMP && step < ZONE_SEGMENTS) {
+    if (setpoint >= segments[step][0])
+      setpoint = segments[step][0];
+    else
+      setpoint += (float)(segments[step][1] / (3600.0f / ZONE_RATE_PERIOD)) *
+                  mDuty;
+    return ZONE_EVENT_NONE;
+  }
+
+  // https://digitalfire.com/schedule/04dsdh
+  if (mPhase == ZONE_SLOW_COOL) {
+    if (setpoint < ZONE_COOL_TEMP || step == ZONE_DONE) {
+      setpoint = 0;
+      mDemand  = false;
+      mPhase   = ZONE_COOLING;
+      return ZONE_EVENT_COOLING;
+    }
+    setpoint -= (float)(83.0 / (3600.0f / ZONE_RATE_PERIOD));
+  }
+  return ZONE_EVENT_NONE;
+}
+
+float Zone::position() const
+{
+  switch (mPhase) {
+  case ZONE_RAMP:
+    if (step >= ZONE_SEGMENTS || segments[step][0] <= 0)
+      return step;
+    return step + 0.5f * fminf(setpoint / segments[step][0], 1);
+  case ZONE_HOLD:
+    return step + 0.5f + 0.5f * fminf(mHoldFraction, 1);
+  case ZONE_SLOW_COOL:
+  case ZONE_COOLING:
+    return ZONE_DONE;
+  default:
+    return 0;
+  }
+}
+
+uint32_t zoneArbitrate(Zone *zones, uint8_t n, uint32_t budget)
+{
+  // furthest along first: late segments are the hottest and lose the most
+  // while starved, zones still ramping just take longer. Ties keep the
+  // zone order.
+  uint8_t order[ZONE_MAX];
+  if (n > ZONE_MAX)
+    n = ZONE_MAX;
+  for (uint8_t i = 0; i < n; i++) {
+    uint8_t j = i;
+    for (; j > 0 && zones[order[j - 1]].position() < zones[i].position(); j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+
+  uint32_t used = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    Zone &z = zones[order[i]];
+    z.relay = z.demand() && (!budget || used + z.watts <= budget) &&
+              z.modulate();
+    if (z.relay)
+      used += z.watts;
+  }
+  return used;
+}
+
+void Zone::curtail(float duty)
+{
+  mDuty = duty < 0 ? 0 : duty > 1 ? 1 : duty;
+}
+
+bool Zone::modulate()
+{
+  if (mDuty >= 1)
+    return true;
+  // one block of on periods per cycle, spares the contactor
+  mSlot = (mSlot + 1) % ZONE_DUTY_SLOTS;
+  return mSlot < mDuty * ZONE_DUTY_SLOTS;
+}
+
+uint32_t Zone::remaining(uint32_t now, float duty) const
+{
+  if (mPhase == ZONE_IDLE || mPhase == ZONE_COOLING)
+    return 0;
+  if (mPhase == ZONE_SLOW_COOL)
+    return ZONE_RATE_PERIOD;
+
+  float minutes = 0;
+  float from    = setpoint;
+  for (int i = step; i < ZONE_SEGMENTS; i++) {
+    float target = segments[i][0];
+    float rate   = segments[i][1] * duty; // degC/h
+
+    if (!(i == step && mPhase == ZONE_HOLD) && target > from) {
+      if (rate <= 0)
+        return ZONE_ETA_UNKNOWN;
+      minutes += (target - from) / rate * 60;
+    }
+    if (target > from)
+      from = target;
+
+    float hold = segments[i][2] > 0 ? segments[i][2] : 0;
+    if (i == step && mPhase == ZONE_HOLD)
+      hold -= (now - holdMillis) / 60000.0f;
+    if (hold > 0)
+      minutes += hold;
+  }
+  return minutes * 60;
+}
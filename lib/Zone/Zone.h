@@ -0,0 +1,97 @@
+#ifndef __zone_h__
+#define __zone_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ZONE_SEGMENTS     4   // preheat, step1, step2, final
+#define ZONE_DONE         5   // step once the program is over
+#define ZONE_RATE_PERIOD  60  // s between rate() calls
+#define ZONE_DIFFERENTIAL 5   // degC below setpoint before heating again
+#define ZONE_COOL_TEMP    760 // degC, slow cooling ends below this setpoint
+#define ZONE_MAX          8   // zones zoneArbitrate() can order
+#define ZONE_DUTY_SLOTS   10  // control periods per curtailed duty cycle
+#define ZONE_ETA_UNKNOWN  0xFFFFFFFF
+
+typedef enum {
+  ZONE_IDLE,
+  ZONE_RAMP,      // setpoint climbs at the segment rate
+  ZONE_HOLD,      // at the segment temperature for its hold time
+  ZONE_SLOW_COOL, // program over, setpoint falls
+  ZONE_COOLING,   // element off for good
+} zone_phase_t;
+
+// What a control() or rate() call changed, the caller updates the UI
+typedef enum {
+  ZONE_EVENT_NONE,
+  ZONE_EVENT_HOLD_START,
+  ZONE_EVENT_HOLDING,
+  ZONE_EVENT_STEP, // hold over, ramping to the next segment
+  ZONE_EVENT_SLOW_COOL,
+  ZONE_EVENT_COOLING,
+} zone_event_t;
+
+// One firing program driving one element. The zone only asks for heat,
+// zoneArbitrate() decides which relays actually close.
+class Zone
+{
+  zone_phase_t mPhase;
+  float mDiff;
+  float mHoldFraction;
+  bool mDemand;
+  float mDuty; // share of full power allowed, 1 unless curtailed
+  uint8_t mSlot;
+  uint32_t mLast;
+  uint32_t mPreheat; // ms on the first ramp, at full power equivalent
+
+  zone_event_t hold(uint32_t now);
+
+public:
+  int segments[ZONE_SEGMENTS][3]; // temperature, rate (degC/h), hold (min)
+  int step;
+  float setpoint;
+  uint32_t initMillis;
+  uint32_t holdMillis;
+
+  uint8_t pin;    // relay
+  uint16_t watts; // element draw counted against the site budget
+  bool relay;     // granted by zoneArbitrate()
+
+  Zone(uint8_t pin, uint16_t watts);
+
+  // Run the program in segments from the current temperature
+  void start(float temp, uint32_t now);
+  // Jump to the end of the program, slow cooling follows
+  void finish() { step = ZONE_SEGMENTS; }
+  // Every control period: heat demand and segment/hold progression
+  zone_event_t control(float temp, uint32_t now);
+  // Every ZONE_RATE_PERIOD: move the setpoint along the ramp or cool-down
+  zone_event_t rate();
+
+  zone_phase_t phase() const { return mPhase; }
+  bool ramping() const { return mPhase == ZONE_RAMP; }
+  bool active() const { return mPhase != ZONE_IDLE && mPhase != ZONE_COOLING; }
+  bool demand() const { return mDemand; }
+  // Progress through the program, step plus the fraction of its ramp/hold
+  float position() const;
+
+  // Cap the average heater duty to [0, 1]. Ramps stretch to match and a
+  // hold that sags below the differential stops counting until it recovers.
+  void curtail(float duty);
+  float duty() const { return mDuty; }
+  // ms spent on the first ramp scaled by the duty, a curtailed preheat is
+  // not taken for a dead element
+  uint32_t preheat() const { return mPreheat; }
+  // s until the program is over at the given duty, ZONE_ETA_UNKNOWN if it
+  // never finishes
+  uint32_t remaining(uint32_t now, float duty) const;
+  uint32_t remaining(uint32_t now) const { return remaining(now, mDuty); }
+  // Once per control period: whether the curtailed duty allows heat now
+  bool modulate();
+};
+
+// Close relays in order of program position until budget W is used up,
+// 0 is no limit. Returns the granted draw.
+uint32_t zoneArbitrate(Zone *zones, uint8_t n, uint32_t budget);
+
+#endif // __zone_h__
@@ -11,16 +11,20 @@ Distributed as-is; no warranty is given.
 
 extern "C" {
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include "freertos/timers.h"
 }
 
 #include "ArduinoOTA.h"
 #include <Arduino.h>
 #include <WiFi.h>
+#include <esp_wifi.h>
 
 #include <AsyncMqttClient.h>
 
 #include "esp_system.h"
+#include "soc/soc.h"
 #include <Ticker.h>
 #include <pthread.h>
 
@@ -45,7 +49,22 @@ extern "C" {
 #include <Wire.h>
 
 #include "Adafruit_MAX31855.h"
+#include "Cooling.h"
+#include "CrashReport.h"
+#include "DeferredLog.h"
+#include "DeltaPatch.h"
+#include "ElementHealth.h"
 #include "LCD16x2.h"
+#include "Metrics.h"
+#include "OtaStream.h"
+#include "PageTemplate.h"
+#include "PowerSave.h"
+#include "Settings.h"
+#include "StatusText.h"
+#include "Telemetry.h"
+#include "ThermoFusion.h"
+#include "TimeService.h"
+#include "Zone.h"
 
 #include "time.h"
 
@@ -54,15 +73,16 @@ extern "C" {
 #define PAPERTRAIL_HOST "logs2.papertrailapp.com"
 #define PAPERTRAIL_PORT 53139
 
+// Deferred to the log task, see lib/DeferredLog and tools/dlog_decode.py.
+// The module selects the runtime level, GET /log?control=2 changes it.
 #ifdef VERBOSE
-#define DBG(msg, ...)                                                          \
-  {                                                                            \
-    Serial.printf("[%lu] " msg, millis(), ##__VA_ARGS__);                      \
-    Serial.flush();                                                            \
-  }
+#define DBGM(module, msg, ...) LOG(module, LOG_DEBUG, msg, ##__VA_ARGS__)
+#define DBGT(msg, text)        LOG_TEXT(LOG_MAIN, LOG_DEBUG, msg, text)
 #else
-#define DBG(...)
+#define DBGM(...)
+#define DBGT(...)
 #endif
+#define DBG(msg, ...) DBGM(LOG_MAIN, msg, ##__VA_ARGS__)
 
 #define NOTIFY(msg, ...)                                                       \
   {                                                                            \
@@ -84,6 +104,8 @@ extern "C" {
 #define I2C_SDA      12
 #define I2C_SCL      14
 #define LCD_RST      33 // WROOM pin9
+// -D S0_PULSE=<pin> for an energy meter's open collector S0 output, it
+// enables the welded contactor and open element checks
 
 #define COSTKWH      2.5
 
@@ -91,46 +113,149 @@ extern "C" {
 #define SMALL_FLUSH  15
 #define FINAL_TEMP   550
 
-#define RATEUPDATE   60 // every 60 seconds
+#ifdef SPI_CS2
+#define PROBES 2
+#else
+#define PROBES 1
+#endif
+
+// Further units, each with a MAX31855 on the same CLK/MISO and a relay
+#if defined(ZONE2_CS)
+#define ZONES 3
+#elif defined(ZONE1_CS)
+#define ZONES 2
+#else
+#define ZONES 1
+#endif
+// The meter sees the sum of every element, its energy cannot be booked to
+// one zone yet
+#if defined(S0_PULSE) && ZONES > 1
+#error "S0_PULSE measures a single zone, build it without ZONE1_CS/ZONE2_CS"
+#endif
+#ifndef ZONE0_WATTS
+#define ZONE0_WATTS 3000 // element rating, counted against the site budget
+#endif
+#ifndef ZONE1_WATTS
+#define ZONE1_WATTS 3000
+#endif
+#ifndef ZONE2_WATTS
+#define ZONE2_WATTS 3000
+#endif
+#ifndef SITE_POWER_LIMIT
+#define SITE_POWER_LIMIT 0 // W on the main fuse for all elements, 0 no limit
+#endif
 
-#define DIFFERENTIAL 5 // degC
+// Safety supervisor, see safetyTask()
+#define SAFETY_PRIORITY      (configMAX_PRIORITIES - 4) // below Wi-Fi/esp_timer
+#define SAFETY_WDT_TIMEOUT   3   // s without a sample before the chip resets
+#define SAFETY_MAX_TEMP      570 // degC
+#define SAFETY_MAX_TINT      60  // degC, board/cold junction
+#define SAFETY_FAULT_TIME    1000 // ms of consecutive faulty samples to trip
+#define SAFETY_FAULT_COUNT   4    // and at least this many, whatever the rate
+#define SAFETY_RUNAWAY_DELAY (3 * 60 * 1000L) // ms of overshoot after relay off
+#define SAFETY_RUNAWAY_RISE  30  // degC above the temp when the relay opened
+#define CONTACTOR_WINDOW     10000 // ms on without a pulse, open element/fuse
+#define CONTACTOR_SETTLE     2000  // ms after opening before pulses count
+#define CONTACTOR_PULSES     2     // pulses while off, welded contactor
+#define PULSE_HISTORY        8
+#define COOL_SAMPLE          30000 // ms between cooling fit samples
+#define COOL_MIN_TIME        10    // min of cooling before judging the fan
+#define COOL_FAULT_RATIO     0.6f  // of the learned rate, slower is a fan fault
+#define ELEMENT_MIN_WH       50    // Wh of ramping needed to judge a run
+#define ELEMENT_ALARM_RATIO  0.8f  // of the trend, lower power or rise alarms
+#define HEAT_TIMEOUT         (60 * 60 * 1000L) // ms to reach the first step
+
+// Core placement, see controlTask() and netTask()
+#define CONTROL_CORE     APP_CPU_NUM // acquisition, control, safety
+#define NET_CORE         PRO_CPU_NUM // Wi-Fi, AsyncTCP, MQTT, SSE, logging
+#define CONTROL_PRIORITY (configMAX_PRIORITIES - 5) // just below safetyTask()
+#define NET_PRIORITY     (tskIDLE_PRIORITY + 2)
+#define CONTROL_PERIOD   5530 // ms between tControl() runs
+#define NET_QUEUE        8    // notifications and SSE events waiting to go out
+
+// Sampling follows the control phase, see sampleRate()
+#define SAMPLE_NEAR  10    // degC from a setpoint or SAFETY_MAX_TEMP
+#define SAMPLE_BOOST 30000 // ms of fast sampling after a switch or new phase
+#define SAMPLE_TINT  30000 // ms between cold junction reads while idle
+
+// Standby between firings, see standbyCheck()
+#define STANDBY_DELAY  (5 * 60 * 1000L) // ms without activity before standby
+#define BUTTON_PERIOD  500   // ms between LCD button polls
+#define BUTTON_STANDBY 1000
+#define SEND_PERIOD    10000 // ms between telemetry messages
+#define SEND_STANDBY   60000
+
+#define OTA_HEALTH_TIMEOUT (5 * 60 * 1000L) // ms for a new image to prove itself
+
+#define PROV_TIMEOUT 20000 // ms to join the network from the captive portal
+
+#define SCAN_MAX_AGE 30000 // ms, older results trigger a background scan
+#define SCAN_MAX_APS 20
+
+#define GRAPH_SAMPLES 1440 // 1 min apart, 24 hours of firing
+#define INFO_SIZE     48   // status line, UTF-8 with an emoji
+#define SEGMENTS_SIZE 384  // firing schedule JSON
+
+#ifndef TELEMETRY_FORMAT
+#define TELEMETRY_FORMAT TELEMETRY_JSON
+#endif
 
-const char *p_mqtt   = "/mqtt.txt";
-char mqtt_user[64]   = {'\0'};
-char mqtt_pass[64]   = {'\0'};
-char mqtt_server[64] = {'\0'};
-uint16_t mqtt_port   = 1883;
+const char *p_mqtt = "/mqtt.txt"; // legacy settings, migrated to NVS
+settings_t settings;
 
-String ssid, pass, hostname;
+char ssid[33]; // provisioning, from the captive portal
+char pass[65];
 
 float temp;
 float tInt;
-float currentSetpoint = -9999;
-std::vector<float> readings;
-std::vector<long> epocTime;
+GraphRing<GRAPH_SAMPLES> graph; // timeUptime() and degC once a minute
 volatile float current;
 volatile uint32_t instPower;
 volatile uint32_t energy = 0;
 volatile uint32_t pulseInterval;
 volatile uint8_t button        = 0;
 
+// Written by safetyTask() only, getTemp() averages the fused reading
+probe_sample_t probeSample[PROBES];
+ProbeHealth probeHealth[PROBES];
+volatile int8_t probeActive = 0; // probe in charge, -1 if none is usable
+volatile float safetyTemp;
+volatile float safetyTInt;
+volatile uint8_t safetyTcError;
+volatile uint8_t safetyFault = 0; // SAFETY_* bits, latched until reboot
+volatile uint32_t safetyAlive = 0; // millis() of the last safetyTask() sample
+// a relay is only closed with no fault latched, see safetyTrip()
+portMUX_TYPE safetyMux = portMUX_INITIALIZER_UNLOCKED;
+
+// S0 pulse times from readPower() for the contactor check
+volatile uint32_t pulseHistory[PULSE_HISTORY];
+volatile uint32_t pulseCount = 0;
+portMUX_TYPE pulseMux        = portMUX_INITIALIZER_UNLOCKED;
+
+CoolingFit cooling;
+float coolingBaseline = 0; // 1/min, learned from previous runs
+bool fanFault         = false;
+
+element_history_t elementHistory;
+element_run_t elementRun; // last finished run
+bool elementAlarm = false;
+
 // Control variables
 volatile uint32_t energyMillis = 0;
-uint32_t initMillis            = 0;
-uint32_t holdMillis            = 0;
-int step                       = 0;
 
-String info                    = "Idle 💤";
+char info[INFO_SIZE]           = "Idle 💤";
 
 // Timer instance numbers
 Ticker controlTimer;
 Ticker safetyTimer;
 Ticker rampTimer;
-Ticker slowCool;
 Ticker tempTimer;
 Ticker sendTimer;
 Ticker buttonTimer;
 Ticker restart;
+Ticker provTimer;
+Ticker otaHealthTimer;
+Ticker safetyWatchdog;
 
 DNSServer dnsServer;
 
@@ -139,24 +264,99 @@ AsyncEventSource events("/events"); // event source (Server-Sent events)
 AsyncWebSocket ws("/ws");           // access at ws://[esp ip]/ws
 
 Adafruit_MAX31855 thermocouple(SPI_CLK, SPI_CS, SPI_MISO);
+#ifdef SPI_CS2
+Adafruit_MAX31855 thermocouple2(SPI_CLK, SPI_CS2, SPI_MISO);
+Adafruit_MAX31855 *probes[PROBES] = {&thermocouple, &thermocouple2};
+#else
+Adafruit_MAX31855 *probes[PROBES] = {&thermocouple};
+#endif
+
+#if ZONES > 1
+Adafruit_MAX31855 zoneProbe1(SPI_CLK, ZONE1_CS, SPI_MISO);
+#endif
+#if ZONES > 2
+Adafruit_MAX31855 zoneProbe2(SPI_CLK, ZONE2_CS, SPI_MISO);
+#endif
+
+// Zone 0 is the unit with the display, S0 meter and probe fusion, the
+// others only run a program. zoneTemp[] of those is written by safetyTask().
+Zone zones[ZONES] = {
+    Zone(RELAY, ZONE0_WATTS),
+#if ZONES > 1
+    Zone(ZONE1_RELAY, ZONE1_WATTS),
+#endif
+#if ZONES > 2
+    Zone(ZONE2_RELAY, ZONE2_WATTS),
+#endif
+};
+Zone &kiln = zones[0];
+Adafruit_MAX31855 *zoneProbes[ZONES] = {
+    NULL,
+#if ZONES > 1
+    &zoneProbe1,
+#endif
+#if ZONES > 2
+    &zoneProbe2,
+#endif
+};
+volatile float zoneTemp[ZONES];
+
+// % of heater power shed on request from /curtail or MQTT
+volatile uint8_t curtailLevel = 0;
+
+volatile uint32_t activityMillis = 0; // last button, request or message
+
+// one program waiting for its start time, see fireAt()
+time_t scheduleAt = 0;
+uint8_t scheduleZone;
+char scheduleProgram[SEGMENTS_SIZE];
 
 PapertrailLogger *errorLog;
 
+// core dump left by the last panic, shipped once over MQTT
+crash_t crash;
+bool crashPending = false;
+
 AsyncMqttClient mqttClient;
 TimerHandle_t mqttReconnectTimer;
 TimerHandle_t wifiReconnectTimer;
 
 LCD16x2 lcd;
 
-void printSegments();
+OtaStream ota;
+DeltaPatch delta;
+
+void printSegments(const Zone &zone);
 void rampRate();
 void tControl();
 void getTemp();
 void lcdMenu();
-String processor(const String &var);
-String readFile(fs::FS &fs, const char *path);
+void standbyCheck();
+void powerActivity();
+void controlPost(uint32_t work);
+void curtailSet(uint8_t level);
+void firePost(const char *input, uint8_t zone);
+void sendPage(AsyncWebServerRequest *request, const template_page_t *page);
+size_t readFile(fs::FS &fs, const char *path, char *buf, size_t size);
 void writeFile(fs::FS &fs, const char *path, const char *message);
 
+typedef enum {
+  SAFETY_OVERTEMP = 0x01,
+  SAFETY_TINT     = 0x02,
+  SAFETY_TC_FAULT = 0x04,
+  SAFETY_RUNAWAY  = 0x08,
+  SAFETY_WELDED   = 0x10,
+  SAFETY_OPEN     = 0x20,
+} safety_fault_t;
+
+// What the contactor check saw when it tripped
+typedef struct {
+  bool relay;         // commanded state
+  uint32_t since;     // ms in that state
+  uint32_t pulses;    // S0 pulses counted in the window
+  uint32_t lastPulse; // ms since the last pulse, 0 if none yet
+} contactor_evidence_t;
+
 typedef enum {
   RED,
   GREEN,
@@ -181,12 +381,138 @@ class CaptiveRequestHandler : public AsyncWebHandler
 
   void handleRequest(AsyncWebServerRequest *request)
   {
-    request->send_P(200, "text/html", HTTP_CONFIG, processor);
+    sendPage(request, &PAGE_CONFIG);
   }
 };
 
 void espRestart() { ESP.restart(); }
 
+typedef enum {
+  RATE_IDLE,   // nothing runs, or cooling with the elements off
+  RATE_ACTIVE, // a program runs
+  RATE_FAST,   // near a setpoint, a relay switch or the safety limit
+  RATES,
+} sample_rate_t;
+
+// ms between safetyTask() samples, the MAX31855 converts every ~100 ms
+const uint16_t SAFETY_PERIOD[RATES] = {2000, 250, 100};
+// ms between getTemp() calls, each averages every sample since the last
+const uint16_t TEMP_PERIOD[RATES]   = {10000, 2000, 1000};
+
+volatile uint32_t sampleBoost = 0; // millis() of the last switch/new phase
+float sampleSum               = 0; // fused samples since the last getTemp()
+uint32_t sampleCount          = 0;
+portMUX_TYPE sampleMux        = portMUX_INITIALIZER_UNLOCKED;
+
+// Work the Tickers and the other tasks hand over to controlTask(). Only
+// controlTask() touches the zones, the others read zoneView[].
+typedef enum {
+  CONTROL_TEMP    = 0x01,    // getTemp()
+  CONTROL_BUTTON  = 0x02,    // readButton()
+  CONTROL_RAMP    = 0x04,    // rampRate()
+  CONTROL_RELAY   = 0x08,    // tControl()
+  CONTROL_CURTAIL = 0x10,    // curtailSet() of curtailPending
+  CONTROL_WATTS   = 0x20,    // element power from the stored history
+  CONTROL_FIRE    = 0x100,   // onFire() of firePending, shifted by the zone
+  CONTROL_FINISH  = 0x10000, // Zone::finish(), shifted by the zone
+} control_work_t;
+
+// A zone as the other tasks see it, copied after every controlTask() pass
+typedef struct {
+  zone_phase_t phase;
+  bool active;
+  int step;
+  float setpoint;
+  uint32_t preheat; // see Zone::preheat()
+  uint32_t eta;     // s, ZONE_ETA_UNKNOWN while paused
+  uint32_t delay;   // s the curtailment adds
+} zone_view_t;
+
+void zoneViewUpdate();
+zone_view_t zoneViewOf(uint8_t zone);
+
+// Latest and worst timing error, us
+typedef struct {
+  uint32_t last;
+  uint32_t max;
+} jitter_t;
+
+TaskHandle_t controlHandle;
+// handed to and from controlTask() under controlMux
+char firePending[ZONES][SEGMENTS_SIZE]; // program start per zone, firePost()
+uint8_t curtailPending;                 // level, curtailPost()
+uint32_t curtailPosted  = 0;            // levels posted
+uint32_t curtailApplied = 0;            // of those, in zoneView[] already
+zone_view_t zoneView[ZONES];
+portMUX_TYPE controlMux = portMUX_INITIALIZER_UNLOCKED;
+volatile uint32_t controlPosted = 0; // micros() of the oldest pending work
+jitter_t controlLatency;             // Ticker on PRO_CPU to controlTask()
+jitter_t controlJitter;              // tControl() period error
+jitter_t controlRun;                 // one controlTask() pass
+jitter_t safetyJitter;               // safetyTask() period error
+
+// One notification, SSE event or publish for netTask()
+typedef struct {
+  const char *event; // SSE event, NULL publishes on topic
+  char topic[64];    // empty for <user>/f/notify
+  uint8_t qos;
+  bool retain;
+  uint16_t len;
+  char data[224]; // telemetry in its largest format
+} net_msg_t;
+
+QueueHandle_t netQueue;
+volatile uint32_t netDropped = 0;
+
+void jitterAdd(jitter_t *j, uint32_t us)
+{
+  j->last = us;
+  if (us > j->max)
+    j->max = us;
+}
+
+// Boot stages, setup() runs BOOT_SAFETY and starts a task for each of the
+// others, BOOT_SERVICES waits on storage and the LCD
+typedef enum {
+  BOOT_SAFETY,
+  BOOT_LCD,
+  BOOT_STORAGE,
+  BOOT_NETWORK,
+  BOOT_SERVICES,
+  BOOT_STAGES,
+} boot_stage_t;
+
+const char *const BOOT_STAGE_NAMES[BOOT_STAGES] = {
+    "safety", "lcd", "storage", "network", "services",
+};
+
+EventGroupHandle_t bootEvents;           // BIT(stage) once it is done
+uint32_t bootStart[BOOT_STAGES];         // us since reset
+uint32_t bootEnd[BOOT_STAGES];           // us since reset, 0 while running
+uint32_t bootSample = 0;                 // us to the first thermocouple read
+
+void bootBegin(boot_stage_t stage) { bootStart[stage] = micros(); }
+
+void bootDone(boot_stage_t stage)
+{
+  bootEnd[stage] = micros();
+  xEventGroupSetBits(bootEvents, BIT(stage));
+  DBG("Boot %s: %u us\n", BOOT_STAGE_NAMES[stage],
+      bootEnd[stage] - bootStart[stage]);
+}
+
+// {"sample":us,"safety":[start,end],...}, end is 0 while a stage runs
+size_t bootJson(char *buf, size_t size)
+{
+  int n = snprintf(buf, size, "{\"sample\":%u", bootSample);
+  for (int i = 0; i < BOOT_STAGES && n > 0 && (size_t)n < size; i++)
+    n += snprintf(buf + n, size - n, ",\"%s\":[%u,%u]", BOOT_STAGE_NAMES[i],
+                  bootStart[i], bootEnd[i]);
+  if (n > 0 && (size_t)n < size)
+    n += snprintf(buf + n, size - n, "}");
+  return n < 0 ? 0 : min((size_t)n, size - 1);
+}
+
 void ledOff()
 {
   digitalWrite(LED_R, HIGH);
@@ -230,45 +556,173 @@ void led(led_color_t color)
   }
 }
 
+// Queue an SSE event, or a notification without one, for netTask().
+// Publishing waits on the TCP/IP task, control must never do that itself.
+void netSend(const char *data, const char *event = NULL)
+{
+  net_msg_t m;
+  m.event    = event;
+  m.topic[0] = '\0';
+  m.qos      = 0;
+  m.retain   = false;
+  strlcpy(m.data, data, sizeof(m.data));
+  m.len = strlen(m.data);
+  if (!netQueue || xQueueSend(netQueue, &m, 0) != pdTRUE)
+    netDropped++;
+}
+
+// Queue an MQTT publish of len bytes on topic, the same way
+void netPublish(const char *topic, const void *data, size_t len, uint8_t qos,
+                bool retain)
+{
+  net_msg_t m;
+  if (len > sizeof(m.data)) {
+    netDropped++;
+    return;
+  }
+  m.event  = NULL;
+  m.qos    = qos;
+  m.retain = retain;
+  m.len    = len;
+  strlcpy(m.topic, topic, sizeof(m.topic));
+  memcpy(m.data, data, len);
+  if (!netQueue || xQueueSend(netQueue, &m, 0) != pdTRUE)
+    netDropped++;
+}
+
+void netTask(void *arg)
+{
+  net_msg_t m;
+  char topic[96];
+
+  for (;;) {
+    xQueueReceive(netQueue, &m, portMAX_DELAY);
+    if (m.event) {
+      events.send(m.data, m.event);
+      continue;
+    }
+    if (m.topic[0])
+      strlcpy(topic, m.topic, sizeof(topic));
+    else
+      snprintf(topic, sizeof(topic), "%s/f/notify", settings.mqttUser);
+    mqttClient.publish(topic, m.qos, m.retain, m.data, m.len);
+  }
+}
+
 // Send notification to HA, max 32 bytes
 void notify(char *msg, size_t length)
 {
-  char _msg[128];
-  sprintf(_msg, "%s - %s", hostname.c_str(), msg);
-  DBG("%s\n", _msg);
-
-  char topic[64] = {'\0'};
-  sprintf(topic, "%s/f/notify", mqtt_user);
-  mqttClient.publish(topic, 0, false, _msg, strlen(_msg));
+  char _msg[160];
+  statusNotify(_msg, sizeof(_msg), settings.hostname, msg, length);
+  // whole, a plain %s stops at LOG_STR_MAX
+  DBGT("%s\n", _msg);
+  netSend(_msg);
 }
 
 void onUpload(AsyncWebServerRequest *request, String filename, size_t index,
               uint8_t *data, size_t len, bool final)
 {
+  static uint8_t lastProgress;
+
+  // every chunk, an upload at 80 MHz and max modem sleep crawls
+  powerActivity();
+
   if (!index) {
+    // digest from the form field ahead of the file, or a header for scripts
+    char sha256[65] = {'\0'};
+    if (request->hasParam("sha256", true))
+      strlcpy(sha256, request->getParam("sha256", true)->value().c_str(),
+              sizeof(sha256));
+    else if (request->hasHeader("X-SHA256"))
+      strlcpy(sha256, request->getHeader("X-SHA256")->value().c_str(),
+              sizeof(sha256));
+
     DBG("Update Start: %s\n", filename.c_str());
     led(CYAN);
-    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-      Update.printError(Serial);
+    lastProgress = 0;
+
+    // a delta patch carries the SHA-256 of the image it rebuilds
+    if (DeltaPatch::isPatch(data, len)) {
+      DBG("Delta patch against %s\n", esp_ota_get_running_partition()->label);
+      delta.begin(&ota);
+    } else {
+      delta.abort();
+      if (!ota.begin(request->contentLength(), sha256)) {
+        DBG("Update failed: %s\n", ota.error());
+        return;
+      }
     }
   }
-  DBG("Progress: %u of %u\r", Update.progress(), Update.size());
-  if (!Update.hasError()) {
-    if (Update.write(data, len) != len) {
-      Update.printError(Serial);
+
+  if (delta.active()) {
+    if (!delta.write(data, len)) {
+      DBG("Update failed: %s\n", delta.error());
+      return;
     }
+  } else if (!ota.active()) {
+    return;
+  } else if (!ota.write(data, len)) {
+    DBG("Update failed: %s\n", ota.error());
+    return;
+  }
+
+  if (ota.progress() != lastProgress) {
+    char progress[4];
+    lastProgress = ota.progress();
+    sprintf(progress, "%u", lastProgress);
+    events.send(progress, "ota");
   }
+
   if (final) {
-    if (Update.end(true)) {
-      DBG("Update Success: %uB\n", index + len);
-      request->redirect("/");
-      restart.once_ms(1000, espRestart);
+    bool ok = delta.active() ? delta.end() : ota.end();
+    if (ok) {
+      char hex[65];
+      ota.digest(hex);
+      DBG("Update Success: %uB sha256: %s\n", ota.written(), hex);
+      events.send("100", "ota");
     } else {
-      Update.printError(Serial);
+      DBG("Update failed: %s\n",
+          delta.hasError() ? delta.error() : ota.error());
     }
   }
 }
 
+// Called once the upload is complete
+void onUpdate(AsyncWebServerRequest *request)
+{
+  if (!request->hasParam("update", true, true) || ota.active() ||
+      delta.active() || ota.hasError() || delta.hasError()) {
+    const char *error = delta.hasError() ? delta.error()
+                        : ota.hasError() ? ota.error()
+                                         : "Update failed, no image";
+    delta.abort();
+    ota.abort();
+    request->send(400, "text/plain", error);
+    led(GREEN);
+    return;
+  }
+
+  request->send(200, "text/plain", "Update OK, rebooting");
+  restart.once_ms(1000, espRestart);
+}
+
+// The core marks a new image valid at boot unless told otherwise.
+// Keep it pending until otaHealthCheck() sees Wi-Fi and a thermocouple
+// reading, any reset before that makes the bootloader roll back.
+extern "C" bool verifyRollbackLater() { return true; }
+
+void otaHealthCheck()
+{
+  if (WiFi.isConnected() && !isnan(temp) && temp != 0) {
+    otaHealthTimer.detach();
+    esp_ota_mark_app_valid_cancel_rollback();
+    DBG("Firmware %s marked valid\n", FIRMWARE_VERSION);
+  } else if (millis() > OTA_HEALTH_TIMEOUT) {
+    DBG("Firmware %s not healthy, rolling back\n", FIRMWARE_VERSION);
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+}
+
 void onRequest(AsyncWebServerRequest *request)
 {
   // Handle Unknown Request
@@ -281,165 +735,481 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client,
   // Handle WebSocket event
 }
 
-String processor(const String &var)
-{
-  if (var == "CSS_TEMPLATE")
-    return FPSTR(HTTP_STYLE);
-  if (var == "INDEX_JS")
-    return FPSTR(HTTP_JS);
-  if (var == "HTML_HEAD_TITLE")
-    return FPSTR(HTML_HEAD_TITLE);
-  if (var == "HTML_INFO_BOX") {
-    String ret = "";
-    if (WiFi.isConnected()) {
-      ret = "<strong> Connected</ strong> to ";
-      ret += WiFi.SSID();
-      ret += "<br><em><small> with IP ";
-      ret += WiFi.localIP().toString();
-      ret += "</small>";
+// Render one item of a %PLACEHOLDER%, see web/*.html and include/template_vars.h
+bool renderVar(uint8_t var, uint32_t item, char *buf, size_t size, size_t *len)
+{
+  int n = 0;
+
+  switch (var) {
+  case VAR_HTML_HEAD_TITLE:
+    n = snprintf(buf, size, "%s", HTML_HEAD_TITLE);
+    break;
+  case VAR_ASSET_VER:
+    n = snprintf(buf, size, "%s", ASSET_VER);
+    break;
+  case VAR_HTML_INFO_BOX: {
+    // the driver record, WiFi.SSID() would build a String
+    wifi_ap_record_t ap;
+    if (WiFi.isConnected() && esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+      IPAddress ip = WiFi.localIP();
+      n = snprintf(buf, size,
+                   "<strong> Connected</ strong> to %s<br><em><small> with IP "
+                   "%u.%u.%u.%u</small>",
+                   (const char *)ap.ssid, ip[0], ip[1], ip[2], ip[3]);
     } else
-      ret = "<strong> Not Connected</ strong>";
-    return ret;
-  }
-  if (var == "UPTIME") {
-    String ret = String(millis() / 1000 / 60);
-    ret += " min ";
-    ret += String((millis() / 1000) % 60);
-    ret += " sec";
-    return ret;
-  }
-  if (var == "CHIP_ID") {
-    String ret = String((uint32_t)ESP.getEfuseMac());
-    return ret;
-  }
-  if (var == "FREE_HEAP") {
-    String ret = String(ESP.getFreeHeap());
-    ret += " bytes";
-    return ret;
-  }
-  if (var == "SKETCH_INFO") {
-    //%USED_BYTES% / &FLASH_SIZE&<br><progress value="%USED_BYTES%"
-    // max="&FLASH_SIZE&">
-    String ret = String(ESP.getSketchSize());
-    ret += " / ";
-    ret += String(ESP.getFlashChipSize());
-    ret += "<br><progress value=\"";
-    ret += String(ESP.getSketchSize());
-    ret += "\" max=\"";
-    ret += String(ESP.getFlashChipSize());
-    ret += "\">";
-    return ret;
-  }
-  if (var == "HOSTNAME")
-    return String(WiFi.getHostname());
-  if (var == "MY_MAC")
-    return WiFi.macAddress();
-  if (var == "MY_RSSI")
-    return String(WiFi.RSSI());
-  if (var == "FW_VER")
-    return String(FIRMWARE_VERSION);
-  if (var == "SDK_VER")
-    return String(ESP_ARDUINO_VERSION_MAJOR) + "." +
-           String(ESP_ARDUINO_VERSION_MINOR) + "." +
-           String(ESP_ARDUINO_VERSION_PATCH);
-  if (var == "ABOUT_DATE") {
-    String ret = String(__DATE__) + " " + String(__TIME__);
-    return ret;
-  }
-  if (var == "GRAPH_DATA" && readings.size()) {
-    String graphString;
-    graphString.reserve(readings.size() * 2);
-    graphString = "[";
-    for (size_t i = 0; i < readings.size() - 1; i++) {
-      graphString += "[";
-      graphString += String(epocTime[i]);
-      graphString += ",";
-      graphString += String(readings[i], 0);
-      graphString += "]";
-      graphString += ",";
+      n = snprintf(buf, size, "<strong> Not Connected</ strong>");
+    break;
+  }
+  case VAR_UPTIME:
+    n = snprintf(buf, size, "%lu min %lu sec", millis() / 1000 / 60,
+                 (millis() / 1000) % 60);
+    break;
+  case VAR_CHIP_ID:
+    n = snprintf(buf, size, "%u", (uint32_t)ESP.getEfuseMac());
+    break;
+  case VAR_FREE_HEAP:
+    n = snprintf(buf, size, "%u bytes", ESP.getFreeHeap());
+    break;
+  case VAR_SKETCH_INFO:
+    n = snprintf(buf, size, "%u / %u<br><progress value=\"%u\" max=\"%u\">",
+                 ESP.getSketchSize(), ESP.getFlashChipSize(),
+                 ESP.getSketchSize(), ESP.getFlashChipSize());
+    break;
+  case VAR_HOSTNAME:
+    n = snprintf(buf, size, "%s", WiFi.getHostname());
+    break;
+  case VAR_MY_MAC: {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    n = snprintf(buf, size, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1],
+                 mac[2], mac[3], mac[4], mac[5]);
+    break;
+  }
+  case VAR_MY_RSSI:
+    n = snprintf(buf, size, "%d", WiFi.RSSI());
+    break;
+  case VAR_FW_VER:
+    n = snprintf(buf, size, "%s", FIRMWARE_VERSION);
+    break;
+  case VAR_SDK_VER:
+    n = snprintf(buf, size, "%d.%d.%d", ESP_ARDUINO_VERSION_MAJOR,
+                 ESP_ARDUINO_VERSION_MINOR, ESP_ARDUINO_VERSION_PATCH);
+    break;
+  case VAR_ABOUT_DATE:
+    n = snprintf(buf, size, "%s %s", __DATE__, __TIME__);
+    break;
+  case VAR_PROV_TIMEOUT:
+    n = snprintf(buf, size, "%u", PROV_TIMEOUT);
+    break;
+  case VAR_BOOT_PROFILE:
+    // one stage per item, the first one is the time to the first sample
+    if (item > BOOT_STAGES) {
+      *len = 0;
+      return false;
+    }
+    if (!item)
+      n = snprintf(buf, size, "first sample %.1f ms", bootSample / 1000.0f);
+    else if (!bootEnd[item - 1])
+      n = snprintf(buf, size, "<br>%s running", BOOT_STAGE_NAMES[item - 1]);
+    else
+      n = snprintf(buf, size, "<br>%s %.1f ms", BOOT_STAGE_NAMES[item - 1],
+                   (bootEnd[item - 1] - bootStart[item - 1]) / 1000.0f);
+    *len = n < 0 ? 0 : min((size_t)n, size - 1);
+    return true;
+  case VAR_SETTINGS_HOSTNAME:
+    n = htmlEscape(buf, size, settings.hostname);
+    break;
+  case VAR_SETTINGS_SERVER:
+    n = htmlEscape(buf, size, settings.mqttServer);
+    break;
+  case VAR_SETTINGS_PORT:
+    n = snprintf(buf, size, "%u", settings.mqttPort);
+    break;
+  case VAR_SETTINGS_USER:
+    n = htmlEscape(buf, size, settings.mqttUser);
+    break;
+  case VAR_GRAPH_DATA: {
+    // one [epoch,degC] pair per item so the history streams out, held back
+    // until SNTP has put the uptime stamps on the calendar, timeEpoch(0) is
+    // the offset
+    return graph.fill(item, timeEpoch(0), buf, size, len);
+  }
+  default:
+    break;
+  }
+
+  *len = n < 0 ? 0 : min((size_t)n, size - 1);
+  return false;
+}
+
+// Stream a pre-split page, placeholders are rendered into the response buffer
+void sendPage(AsyncWebServerRequest *request, const template_page_t *page)
+{
+  powerActivity();
+  PageRenderer renderer(page, renderVar);
+  request->send(request->beginChunkedResponse(
+      "text/html", [renderer](uint8_t *buffer, size_t maxLen,
+                              size_t index) mutable -> size_t {
+        return renderer.fill(buffer, maxLen);
+      }));
+}
+
+// Static assets are minified and gzipped at build time, see tools/build_assets.py
+void sendAsset(AsyncWebServerRequest *request, const char *type,
+               const uint8_t *data, size_t len, const char *etag)
+{
+  AsyncWebServerResponse *response;
+
+  AsyncWebHeader *match = request->getHeader("If-None-Match");
+  if (match && !strcmp(match->value().c_str(), etag))
+    response = request->beginResponse(304);
+  else {
+    response = request->beginResponse_P(200, type, data, len);
+    response->addHeader("Content-Encoding", "gzip");
+  }
+
+  response->addHeader("ETag", etag);
+  // URLs carry ?v=ASSET_VER, a new build never hits a stale copy
+  response->addHeader("Cache-Control", "public, max-age=31536000, immutable");
+  request->send(response);
+}
+
+void assetServer()
+{
+  server.on("/app.css", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendAsset(request, APP_CSS_TYPE, APP_CSS_GZ, APP_CSS_GZ_LEN, APP_CSS_ETAG);
+  });
+
+  server.on("/app.js", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendAsset(request, APP_JS_TYPE, APP_JS_GZ, APP_JS_GZ_LEN, APP_JS_ETAG);
+  });
+}
+
+// Wi-Fi scan cache, refreshed in the background so /scan never blocks
+typedef struct {
+  char ssid[33];
+  uint8_t bssid[6];
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t secure;
+} scan_ap_t;
+
+scan_ap_t scanAps[SCAN_MAX_APS];
+uint8_t scanCount         = 0;
+uint32_t scanMillis       = 0; // 0 = no result yet
+volatile bool scanRunning = false;
+portMUX_TYPE scanMux      = portMUX_INITIALIZER_UNLOCKED;
+
+void scanStart()
+{
+  if (scanRunning)
+    return;
+  if (WiFi.scanNetworks(true, false, false, 100) == WIFI_SCAN_RUNNING) {
+    scanRunning = true;
+    DBGM(LOG_NET, "Scan started\n");
+  }
+}
+
+// SYSTEM_EVENT_SCAN_DONE, copy the results out of the driver
+void scanDone()
+{
+  int n = WiFi.scanComplete();
+  if (n < 0) {
+    scanRunning = false;
+    return;
+  }
+  if (n > SCAN_MAX_APS)
+    n = SCAN_MAX_APS;
+
+  scan_ap_t aps[SCAN_MAX_APS];
+  for (int i = 0; i < n; i++) {
+    // the driver record, WiFi.SSID() would build a String per AP
+    wifi_ap_record_t *ap = (wifi_ap_record_t *)WiFi.getScanInfoByIndex(i);
+    strlcpy(aps[i].ssid, ap ? (const char *)ap->ssid : "",
+            sizeof(aps[i].ssid));
+    memcpy(aps[i].bssid, WiFi.BSSID(i), sizeof(aps[i].bssid));
+    aps[i].rssi    = WiFi.RSSI(i);
+    aps[i].channel = WiFi.channel(i);
+    aps[i].secure  = WiFi.encryptionType(i);
+  }
+  WiFi.scanDelete();
+
+  portENTER_CRITICAL(&scanMux);
+  memcpy(scanAps, aps, n * sizeof(scan_ap_t));
+  scanCount  = n;
+  scanMillis = millis() | 1;
+  portEXIT_CRITICAL(&scanMux);
+
+  scanRunning = false;
+  DBGM(LOG_NET, "Scan done: %d\n", n);
+}
+
+// JSON string body, quotes, backslashes and control characters escaped
+size_t jsonEscape(char *buf, size_t size, const char *str)
+{
+  size_t n = 0;
+  for (; *str && n + 7 < size; str++) {
+    uint8_t c = *str;
+    if (c == '"' || c == '\\') {
+      buf[n++] = '\\';
+      buf[n++] = c;
+    } else if (c < 0x20)
+      n += snprintf(buf + n, size - n, "\\u%04x", c);
+    else
+      buf[n++] = c;
+  }
+  buf[n] = '\0';
+  return n;
+}
+
+// {"age":ms,"scanning":bool,"aps":[...]}, one access point per item
+size_t scanFill(int *item, uint8_t *buffer, size_t maxLen)
+{
+  size_t n = 0;
+
+  while (maxLen - n > 160) {
+    char *buf   = (char *)buffer + n;
+    size_t size = maxLen - n;
+
+    if (*item < 0) {
+      n += snprintf(buf, size, "{\"age\":%ld,\"scanning\":%s,\"aps\":[",
+                    scanMillis ? (long)(millis() - scanMillis) : -1L,
+                    scanRunning ? "true" : "false");
+    } else {
+      scan_ap_t ap;
+      bool valid;
+      portENTER_CRITICAL(&scanMux);
+      valid = *item < scanCount;
+      if (valid)
+        ap = scanAps[*item];
+      portEXIT_CRITICAL(&scanMux);
+
+      if (!valid) {
+        // past the footer, end of response
+        if (*item > SCAN_MAX_APS)
+          break;
+        n += snprintf(buf, size, "]}");
+        *item = SCAN_MAX_APS + 1;
+        break;
+      }
+
+      char ssid[sizeof(ap.ssid) * 6];
+      jsonEscape(ssid, sizeof(ssid), ap.ssid);
+      n += snprintf(buf, size,
+                    "%s{\"rssi\":%d,\"ssid\":\"%s\",\"bssid\":\"%02X:%02X:%02X:"
+                    "%02X:%02X:%02X\",\"channel\":%u,\"secure\":%u}",
+                    *item ? "," : "", ap.rssi, ssid, ap.bssid[0], ap.bssid[1],
+                    ap.bssid[2], ap.bssid[3], ap.bssid[4], ap.bssid[5],
+                    ap.channel, ap.secure);
     }
-    graphString += "[";
-    graphString += String(epocTime[readings.size() - 1]);
-    graphString += ",";
-    graphString += String(readings[readings.size() - 1], 0);
-    graphString += "]";
-    graphString += "]";
-    return graphString;
+    (*item)++;
+  }
+
+  // not enough room for a whole entry, ask again once the socket drained
+  if (!n && *item <= SCAN_MAX_APS)
+    return RESPONSE_TRY_AGAIN;
+  return n;
+}
+
+// Settings from a form, same field names as the captive portal
+void settingsFromParams(AsyncWebServerRequest *request, settings_t *s)
+{
+  for (int i = 0; i < request->params(); i++) {
+    AsyncWebParameter *p = request->getParam(i);
+    if (!p->isPost())
+      continue;
+    const char *name  = p->name().c_str();
+    const char *value = p->value().c_str();
+    if (!strcmp(name, "hostname"))
+      SETTINGS_SET(s->hostname, value);
+    if (!strcmp(name, "server"))
+      SETTINGS_SET(s->mqttServer, value);
+    if (!strcmp(name, "port"))
+      s->mqttPort = atoi(value);
+    if (!strcmp(name, "user"))
+      SETTINGS_SET(s->mqttUser, value);
+    // the settings page leaves the password empty to keep it
+    if (!strcmp(name, "mqtt_pass") && *value)
+      SETTINGS_SET(s->mqttPass, value);
+  }
+
+  if (!s->mqttPort)
+    s->mqttPort = SETTINGS_DEFAULT_PORT;
+}
+
+// Settings from JSON, the legacy /mqtt.txt keys, absent keys are kept
+bool settingsFromJson(settings_t *s, const char *json, size_t len)
+{
+  StaticJsonDocument<384> doc;
+  DeserializationError error = deserializeJson(doc, json, len);
+  if (error) {
+    DBG("deserializeJson() failed: %s\n", error.c_str());
+    return false;
+  }
+
+  if (doc["hostname"].is<const char *>())
+    SETTINGS_SET(s->hostname, doc["hostname"].as<const char *>());
+  if (doc["s"].is<const char *>())
+    SETTINGS_SET(s->mqttServer, doc["s"].as<const char *>());
+  if (doc["u"].is<const char *>())
+    SETTINGS_SET(s->mqttUser, doc["u"].as<const char *>());
+  if (doc["pass"].is<const char *>())
+    SETTINGS_SET(s->mqttPass, doc["pass"].as<const char *>());
+  // the captive portal stored the port as a string
+  if (doc["port"].is<const char *>())
+    s->mqttPort = atoi(doc["port"].as<const char *>());
+  else if (doc["port"].is<int>())
+    s->mqttPort = doc["port"];
+
+  if (!s->mqttPort)
+    s->mqttPort = SETTINGS_DEFAULT_PORT;
+  return true;
+}
+
+// Captive portal provisioning, driven by WiFiEvent() and provTimer
+typedef enum {
+  PROV_IDLE,
+  PROV_CONNECTING,
+  PROV_CONNECTED,
+  PROV_FAILED,
+} prov_state_t;
+
+volatile prov_state_t provState = PROV_IDLE;
+volatile uint8_t provReason     = 0; // last wifi_err_reason_t
+uint32_t provMillis             = 0;
+
+void provFail()
+{
+  if (provState != PROV_CONNECTING)
+    return;
+  provTimer.detach();
+  provState = PROV_FAILED;
+  DBGM(LOG_NET, "Provisioning failed, reason: %u\n", provReason);
+
+  // stop retrying, keep the portal up
+  WiFi.disconnect();
+  WiFi.mode(WIFI_AP);
+}
+
+void provBegin()
+{
+  provReason = 0;
+  provMillis = millis();
+  provState  = PROV_CONNECTING;
+
+  WiFi.mode(WIFI_AP_STA);
+  WiFi.persistent(true);
+  WiFi.begin(ssid, pass);
+  DBGM(LOG_NET, "Connecting to WiFi %s\n", ssid);
+
+  provTimer.once_ms(PROV_TIMEOUT, provFail);
+}
+
+void provEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+  if (provState != PROV_CONNECTING)
+    return;
+
+  switch (event) {
+  case SYSTEM_EVENT_STA_GOT_IP:
+    provTimer.detach();
+    provState = PROV_CONNECTED;
+    DBGM(LOG_NET, "Connected\n");
+    // give the portal page time to show the new address
+    restart.once_ms(5000, espRestart);
+    break;
+  case SYSTEM_EVENT_STA_DISCONNECTED:
+    provReason = info.wifi_sta_disconnected.reason;
+    // a wrong password won't get better with retries
+    if (provReason == WIFI_REASON_AUTH_FAIL ||
+        provReason == WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT ||
+        provReason == WIFI_REASON_HANDSHAKE_TIMEOUT)
+      provFail();
+    break;
+  default:
+    break;
   }
+}
 
-  return String();
+const char *provError()
+{
+  switch (provReason) {
+  case 0:
+    return "timeout";
+  case WIFI_REASON_AUTH_FAIL:
+  case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+  case WIFI_REASON_HANDSHAKE_TIMEOUT:
+    return "wrong password";
+  case WIFI_REASON_NO_AP_FOUND:
+    return "network not found";
+  default:
+    return "disconnected";
+  }
 }
 
 void captiveServer()
 {
   server.on("/", HTTP_POST, [](AsyncWebServerRequest *request) {
-    int params = request->params();
-    StaticJsonDocument<384> doc;
-    char output[384] = {'\0'};
-    for (int i = 0; i < params; i++) {
+    if (provState == PROV_CONNECTING) {
+      sendPage(request, &PAGE_PROVISION);
+      return;
+    }
+
+    for (int i = 0; i < request->params(); i++) {
       AsyncWebParameter *p = request->getParam(i);
       if (p->isPost()) {
         // HTTP POST ssid value
-        if (p->name() == "ssid") {
-          ssid = p->value().c_str();
-          DBG("SSID set to: %s\n", ssid.c_str());
-        }
-        if (p->name() == "pass") {
-          pass = p->value().c_str();
-          DBG("Password set to: %s\n", pass.c_str());
-        }
-        if (p->name() == "hostname") {
-          doc["hostname"] = p->value().c_str();
+        if (!strcmp(p->name().c_str(), "ssid")) {
+          strlcpy(ssid, p->value().c_str(), sizeof(ssid));
+          DBG("SSID set to: %s\n", ssid);
         }
-        if (p->name() == "server") {
-          doc["s"] = p->value().c_str();
-        }
-        if (p->name() == "mqtt_pass") {
-          doc["pass"] = p->value().c_str();
-        }
-        if (p->name() == "user") {
-          doc["u"] = p->value().c_str();
-        }
-        if (p->name() == "port") {
-          doc["port"] = p->value().c_str();
+        if (!strcmp(p->name().c_str(), "pass")) {
+          strlcpy(pass, p->value().c_str(), sizeof(pass));
+          DBG("Password set to: %s\n", pass);
         }
       }
     }
-    serializeJson(doc, output);
-    DBG("%s\n", output);
-    writeFile(SPIFFS, p_mqtt, output);
-
-    WiFi.persistent(true);
-    WiFi.begin(ssid.c_str(), pass.c_str());
-    DBG("Connecting to WiFi ..");
-    while (WiFi.status() != WL_CONNECTED) {
-      Serial.print('.');
-      delay(100);
-    }
-    DBG("Connected\n");
-    restart.once_ms(1000, espRestart);
-    request->redirect("http://" + WiFi.localIP().toString());
+    settingsFromParams(request, &settings);
+    settingsSave(&settings);
+
+    provBegin();
+    sendPage(request, &PAGE_PROVISION);
+  });
+
+  server.on("/status", HTTP_GET, [](AsyncWebServerRequest *request) {
+    static const char *states[] = {"idle", "connecting", "connected",
+                                   "failed"};
+    char ssidJson[sizeof(scan_ap_t::ssid) * 6];
+    char json[192];
+
+    jsonEscape(ssidJson, sizeof(ssidJson), ssid);
+    IPAddress ip = WiFi.localIP();
+    snprintf(json, sizeof(json),
+             "{\"state\":\"%s\",\"ssid\":\"%s\",\"elapsed\":%lu,"
+             "\"ip\":\"%u.%u.%u.%u\",\"error\":\"%s\"}",
+             states[provState], ssidJson,
+             provState == PROV_IDLE ? 0 : millis() - provMillis, ip[0], ip[1],
+             ip[2], ip[3], provError());
+    request->send(200, "application/json", json);
   });
 }
 
-// Read File from SPIFFS
-String readFile(fs::FS &fs, const char *path)
+// Read the first line of a file from SPIFFS into buf, returns its length
+size_t readFile(fs::FS &fs, const char *path, char *buf, size_t size)
 {
   DBG("Reading file: %s\r\n", path);
 
+  buf[0]    = '\0';
   File file = fs.open(path);
   if (!file || file.isDirectory()) {
     DBG("- failed to open file for reading\n");
-    return String();
+    return 0;
   }
 
-  String fileContent;
-  while (file.available()) {
-    fileContent = file.readStringUntil('\n');
-    DBG("Read: %s\n", fileContent.c_str());
-    break;
-  }
-  return fileContent;
+  size_t n = file.readBytesUntil('\n', buf, size - 1);
+  buf[n]   = '\0';
+  DBG("Read: %s\n", buf);
+  return n;
 }
 
 // Write file to SPIFFS
@@ -459,162 +1229,632 @@ void writeFile(fs::FS &fs, const char *path, const char *message)
   }
 }
 
-// temperature, rate, hold/soak (min)
-int segments[4][3]     = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
 const char *p_segments = "/segments.txt";
 
-void onFire(String input)
+float zoneTempOf(uint8_t zone) { return zone ? zoneTemp[zone] : temp; }
+
+// Start a program on one zone, {"preheat":{"st":..,"r":..,"h":..},"step1":..}
+void onFire(const char *input, uint8_t zone = 0)
 {
-  StaticJsonDocument<384> doc;
+  static const char *const keys[ZONE_SEGMENTS] = {"preheat", "step1", "step2",
+                                                  "final"};
+  if (zone >= ZONES)
+    return;
+  Zone &z = zones[zone];
+  powerActivity();
+
+  StaticJsonDocument<SEGMENTS_SIZE> doc;
   deserializeJson(doc, input);
 
-  segments[0][0] = doc["preheat"]["st"];
-  segments[0][1] = doc["preheat"]["r"];
-  segments[0][2] = doc["preheat"]["h"];
-  segments[1][0] = doc["step1"]["st"];
-  segments[1][1] = doc["step1"]["r"];
-  segments[1][2] = doc["step1"]["h"];
-  segments[2][0] = doc["step2"]["st"];
-  segments[2][1] = doc["step2"]["r"];
-  segments[2][2] = doc["step2"]["h"];
-  segments[3][0] = doc["final"]["st"];
-  segments[3][1] = doc["final"]["r"];
-  segments[3][2] = doc["final"]["h"];
+  // temperature, rate, hold/soak (min)
+  for (int i = 0; i < ZONE_SEGMENTS; i++) {
+    z.segments[i][0] = doc[keys[i]]["st"];
+    z.segments[i][1] = doc[keys[i]]["r"];
+    z.segments[i][2] = doc[keys[i]]["h"];
+  }
 
   getTemp();
+  z.start(zoneTempOf(zone), millis());
+  sampleBoost = millis();
+  printSegments(z);
 
-  // guess the step
-  // TODO publish retain and account for hold
-  if (temp > segments[3][0])
-    step = 3;
-  else if (temp > segments[1][0])
-    step = 3;
-  else if (temp > segments[1][0])
-    step = 2;
-  else if (temp > segments[0][0])
-    step = 1;
-
-  // empty parameters (toilet)
-  if (segments[3][0] == 0)
-    step = 0;
-
-  info             = "Flushing 🔥 @" + String(segments[step][0]) + " C";
-  initMillis       = millis();
-  currentSetpoint  = temp;
-
-  String flushType = segments[0][2] > 15 ? "Poo" : "Pee";
+  digitalWrite(FAN, HIGH);
+  // both timers serve every zone, they keep running once started
+  if (!controlTimer.active())
+    controlTimer.attach_ms(CONTROL_PERIOD, controlPost,
+                           (uint32_t)CONTROL_RELAY);
+  if (!rampTimer.active())
+    rampTimer.attach_ms(ZONE_RATE_PERIOD * 1000L, controlPost,
+                        (uint32_t)CONTROL_RAMP);
+
+  if (zone)
+    return;
+  statusStart(info, sizeof(info), z);
 
+  char line[32];
+  statusStartLcd(line, sizeof(line), z);
   lcd.lcdClear();
   lcd.lcdGoToXY(1, 1);
-  lcd.lcdWrite(
-      (char *)("Flushing: " + String(segments[step][0]) + " C " + flushType)
-          .c_str());
+  lcd.lcdWrite(line);
   lcdMenu();
-
-  printSegments();
-  rampRate();
-  digitalWrite(FAN, HIGH);
-  controlTimer.attach_ms(5530L, tControl);
-  rampTimer.attach_ms(RATEUPDATE * 1000L, rampRate);
 }
 
-void sendData()
+// Start a program from any task, controlTask() runs onFire(). A later
+// start of the same zone replaces one that has not run yet.
+void firePost(const char *input, uint8_t zone)
 {
-  StaticJsonDocument<192> doc;
-  char payload[192];
-
-  current          = (instPower / 1000.0f) / 230.0f;
-
-  JsonObject feeds = doc.createNestedObject("feeds");
-  feeds["T"]       = temp;
-  feeds["I"]       = current;
-  feeds["P"]       = instPower / 1000.0f;
-  feeds["E"]       = energy;
-  feeds["$"]       = energy / 1000.0f * COSTKWH;
-  feeds["Tint"]    = tInt;
-  feeds["St"]      = currentSetpoint;
-  feeds["Step"]    = step;
-  feeds["RSSI"]    = WiFi.RSSI();
-
-  serializeJson(doc, payload);
-
-  char topic[64] = {'\0'};
-  sprintf(topic, "%s/g/%s/json", mqtt_user, hostname.c_str());
-
-  mqttClient.publish(topic, 0, false, payload, strlen(payload));
-
-  DBG("topic: %s\n", topic);
-  DBG("Publish: %s\n", payload);
-
-  current   = 0;
-  instPower = 0;
+  if (zone >= ZONES)
+    return;
+  portENTER_CRITICAL(&controlMux);
+  strlcpy(firePending[zone], input, sizeof(firePending[zone]));
+  portEXIT_CRITICAL(&controlMux);
+  controlPost(CONTROL_FIRE << zone);
 }
 
-void safetyCheck()
+// Start now, or at the unix time at. The start waits for SNTP if the clock
+// is not set yet, a later call replaces a pending start. False for a zone
+// this controller does not have.
+bool fireAt(const char *input, long zone, time_t at)
 {
-  static bool tIntError  = false;
-  static bool noRlyError = false;
-  static bool highTError = false;
-
-  // if (controlTimer.active()) {
-  //   if (temp > (currentSetpoint + 10)) // TODO check differential
-  //   {
-  //     DBG("HIGH TEMPERATURE ALARM\n");
-  //   } else if (temp < (currentSetpoint - 20)) {
-  //     DBG("LOW TEMPERATURE ALARM\n");
-  //   }
-  // }
-
-  if (tInt > 60) {
-    if (!tIntError) {
-      char tIntChar[32];
-      sprintf(tIntChar, "High internal temp: %.1f°C", tInt);
-      notify(tIntChar, strlen(tIntChar));
-      tIntError = true;
-    }
-  } else {
-    tIntError = false;
+  if (zone < 0 || zone >= ZONES) {
+    DBGM(LOG_CONTROL, "No zone %ld\n", zone);
+    return false;
   }
 
-  if (temp > 570) {
-    if (!highTError) {
-      char highTchar[32];
-      sprintf(highTchar, "High temp: %.1f°C", temp);
-      notify(highTchar, strlen(highTchar));
-      highTError = true;
-    }
-  } else {
-    highTError = false;
+  if (!at || (timeSynced() && at <= time(NULL))) {
+    scheduleAt = 0;
+    firePost(input, zone);
+    return true;
   }
 
-  uint32_t elapsedTime = millis() - initMillis;
+  portENTER_CRITICAL(&controlMux);
+  strlcpy(scheduleProgram, input, sizeof(scheduleProgram));
+  scheduleZone = zone;
+  scheduleAt   = at;
+  portEXIT_CRITICAL(&controlMux);
+
+  char msg[64];
+  struct tm start;
+  localtime_r(&at, &start);
+  snprintf(msg, sizeof(msg), "Zone %ld starts at %02d:%02d", zone,
+           start.tm_hour, start.tm_min);
+  notify(msg, strlen(msg));
+  return true;
+}
 
-  if (elapsedTime > 60 * 1000 * 1000 && step == 0 && rampTimer.active()) {
-    char msg[] = "Too long to heat, check element/thermostat";
-    notify(msg, strlen(msg));
-    step = 4;
+// /small and /big: ?zone=1 runs the program on another unit, ?at=<unix
+// time> starts later
+void fireRequest(AsyncWebServerRequest *request, const char *program)
+{
+  long zone = request->hasParam("zone")
+                  ? atol(request->getParam("zone")->value().c_str())
+                  : 0;
+  time_t at = request->hasParam("at")
+                  ? atol(request->getParam("at")->value().c_str())
+                  : 0;
+  if (!fireAt(program, zone, at)) {
+    request->send(400, "text/plain", "No such zone");
+    return;
   }
-
-  // TODO long time for cooling == fan problem
-
-  if (temp < 100 && step == 5)
-    restart.once_ms(1000, espRestart);
+  request->redirect("/");
 }
 
-void printSegments()
+void scheduleCheck()
 {
-  DBG("Firing ");
-  for (size_t i = 0; i < sizeof(segments) / sizeof(segments[0]); i++) {
-    Serial.print("{");
-    for (size_t j = 0; j < sizeof(segments[0]) / (sizeof(int)); j++) {
-      Serial.printf("%d,", segments[i][j]);
-    }
-    Serial.print("} ");
+  if (!scheduleAt || !timeSynced())
+    return;
+
+  // fireAt() may replace or drop it from the network side meanwhile
+  time_t now = time(NULL);
+  portENTER_CRITICAL(&controlMux);
+  bool due     = scheduleAt && now >= scheduleAt;
+  uint8_t zone = scheduleZone;
+  if (due) {
+    memcpy(firePending[zone], scheduleProgram, sizeof(firePending[zone]));
+    scheduleAt = 0;
   }
-  Serial.print("\n");
+  portEXIT_CRITICAL(&controlMux);
+  if (due)
+    controlPost(CONTROL_FIRE << zone);
 }
 
-void IRAM_ATTR readPower()
+void sendData()
+{
+  telemetry_t t;
+  uint8_t payload[224];
+  zone_view_t view = zoneViewOf(0);
+
+  current    = (instPower / 1000.0f) / 230.0f;
+
+  t.temp     = temp;
+  t.current  = current;
+  t.power    = instPower / 1000.0f;
+  t.energy   = energy;
+  t.cost     = energy / 1000.0f * COSTKWH;
+  t.tInt     = tInt;
+  t.setpoint = view.setpoint;
+  t.step     = view.step;
+  t.rssi     = WiFi.RSSI();
+  t.eta      = view.eta;
+  t.curtail  = curtailLevel;
+
+  size_t len = telemetryEncode(t, TELEMETRY_FORMAT, payload, sizeof(payload));
+
+  char topic[64] = {'\0'};
+  sprintf(topic, "%s/g/%s/%s", settings.mqttUser, settings.hostname,
+          telemetrySuffix(TELEMETRY_FORMAT));
+
+  if (len)
+    netPublish(topic, payload, len, 0, false);
+
+  DBGM(LOG_CONTROL, "topic: %s\n", topic);
+  DBGM(LOG_CONTROL, "Publish: %uB\n", len);
+
+  current   = 0;
+  instPower = 0;
+}
+
+contactor_evidence_t contactorEvidence;
+
+// Cut every element, tControl() will not switch them back on
+void safetyTrip(safety_fault_t fault)
+{
+  portENTER_CRITICAL(&safetyMux);
+  safetyFault |= fault;
+  for (int i = 0; i < ZONES; i++)
+    digitalWrite(zones[i].pin, LOW);
+  portEXIT_CRITICAL(&safetyMux);
+  digitalWrite(FAN, HIGH);
+}
+
+// The supervisor's own watchdog, on the esp_timer task so it does not
+// share a core with safetyTask(). The task watchdog keeps its global
+// settings for the idle tasks and long flash operations.
+void safetyWatchdogCheck()
+{
+  if (millis() - safetyAlive < SAFETY_WDT_TIMEOUT * 1000L)
+    return;
+  for (int i = 0; i < ZONES; i++)
+    digitalWrite(zones[i].pin, LOW);
+  // a panic, so the core dump shows where the supervisor got stuck
+  esp_system_abort("safety task stalled");
+}
+
+// Each read is a whole SPI frame, idle takes the temperature alone and the
+// fault bits only when it fails
+float probeRead(Adafruit_MAX31855 *probe, uint8_t *error)
+{
+  float t = probe->readCelsius();
+  *error  = isnan(t) ? probe->readError() : 0;
+  return t;
+}
+
+// One sample of every probe, fused into safetyTemp/safetyTInt/safetyTcError.
+// Also taken once from bootSafety() before the task starts. ms is the time
+// since the previous sample. Idle keeps the cold junction for SAMPLE_TINT.
+void safetySample(uint32_t ms, bool idle)
+{
+  static uint32_t tIntMillis = 0;
+  bool tIntDue = !idle || millis() - tIntMillis >= SAMPLE_TINT;
+  if (tIntDue)
+    tIntMillis = millis();
+
+  for (int i = 0; i < PROBES; i++) {
+    probeSample[i].temp = probeRead(probes[i], &probeSample[i].error);
+    if (tIntDue)
+      probeSample[i].tInt = probes[i]->readInternal();
+  }
+  for (int i = 0; i < PROBES; i++)
+    probeHealth[i].update(probeSample[i],
+                          PROBES > 1 ? &probeSample[PROBES - 1 - i] : NULL,
+                          ms);
+
+  probe_sample_t fused;
+  probeActive   = thermoFuse(probeSample, probeHealth, PROBES, &fused);
+  safetyTemp    = fused.temp;
+  safetyTInt    = fused.tInt;
+  safetyTcError = fused.error;
+
+  if (!(fused.error & (PROBE_OC | PROBE_SCV)) && !isnan(fused.temp)) {
+    portENTER_CRITICAL(&sampleMux);
+    sampleSum += fused.temp;
+    sampleCount++;
+    portEXIT_CRITICAL(&sampleMux);
+  }
+
+  zoneTemp[0] = fused.temp;
+  for (int i = 1; i < ZONES; i++) {
+    uint8_t error;
+    float t     = probeRead(zoneProbes[i], &error);
+    zoneTemp[i] = error & (PROBE_OC | PROBE_SCV) ? NAN : t;
+  }
+
+  if (!bootSample)
+    bootSample = micros();
+}
+
+// Fast while a zone is near its setpoint, right after a relay switch or
+// phase change and close to the safety limit, slow when nothing heats
+sample_rate_t sampleRate()
+{
+  if (safetyTemp > SAFETY_MAX_TEMP - SAMPLE_NEAR ||
+      millis() - sampleBoost < SAMPLE_BOOST)
+    return RATE_FAST;
+
+  sample_rate_t rate = RATE_IDLE;
+  for (int i = 0; i < ZONES; i++) {
+    zone_view_t view = zoneViewOf(i);
+    if (view.phase != ZONE_RAMP && view.phase != ZONE_HOLD) {
+      if (digitalRead(zones[i].pin))
+        rate = RATE_ACTIVE;
+      continue;
+    }
+    if (fabsf(view.setpoint - zoneTemp[i]) < SAMPLE_NEAR)
+      return RATE_FAST;
+    rate = RATE_ACTIVE;
+  }
+  return rate;
+}
+
+// getTemp() follows the same rate, called from safetyCheck() so the timer
+// is never re-armed from its own callback
+void sampleAdapt()
+{
+  static uint32_t period = 0;
+  uint32_t next          = TEMP_PERIOD[sampleRate()];
+
+  if (next == period)
+    return;
+  period = next;
+  tempTimer.attach_ms(period, controlPost, (uint32_t)CONTROL_TEMP);
+}
+
+// S0 pulses after the given millis(), at most PULSE_HISTORY
+uint32_t pulsesSince(uint32_t since, uint32_t *last)
+{
+  uint32_t n = 0;
+
+  portENTER_CRITICAL(&pulseMux);
+  uint32_t count = pulseCount;
+  *last          = count ? pulseHistory[(count - 1) % PULSE_HISTORY] : 0;
+  for (uint32_t i = count; i > 0 && count - i < PULSE_HISTORY; i--) {
+    if ((int32_t)(pulseHistory[(i - 1) % PULSE_HISTORY] - since) <= 0)
+      break;
+    n++;
+  }
+  portEXIT_CRITICAL(&pulseMux);
+
+  return n;
+}
+
+// Energy must flow while the relay is on and stop once it is off
+void contactorCheck(bool relay, uint32_t since)
+{
+  uint32_t now = millis();
+  uint32_t last;
+  uint32_t pulses;
+  safety_fault_t fault;
+
+  if (relay && since > CONTACTOR_WINDOW) {
+    pulses = pulsesSince(now - CONTACTOR_WINDOW, &last);
+    if (pulses)
+      return;
+    fault = SAFETY_OPEN;
+  } else if (!relay && since > CONTACTOR_SETTLE) {
+    pulses = pulsesSince(now - since + CONTACTOR_SETTLE, &last);
+    if (pulses < CONTACTOR_PULSES)
+      return;
+    fault = SAFETY_WELDED;
+  } else {
+    return;
+  }
+
+  if (safetyFault & fault)
+    return;
+  contactorEvidence.relay     = relay;
+  contactorEvidence.since     = since;
+  contactorEvidence.pulses    = pulses;
+  contactorEvidence.lastPulse = pulseCount ? now - last : 0;
+  safetyTrip(fault);
+}
+
+// Highest priority application task, owns the thermocouple and the relay
+// cut-off. Must not call into the network, LCD or flash, notifications are
+// sent from safetyCheck()
+void safetyTask(void *arg)
+{
+  uint32_t faultMs            = 0;
+  uint32_t faults             = 0;
+  uint32_t zoneFaultMs[ZONES] = {0};
+  uint32_t zoneFaults[ZONES]  = {0};
+  bool relayOn[ZONES]         = {false};
+  uint32_t relayMillis[ZONES] = {0};
+  float relayTemp[ZONES]      = {0};
+
+  TickType_t wake = xTaskGetTickCount();
+  uint32_t last   = 0;
+  for (;;) {
+    sample_rate_t rate = sampleRate();
+    uint32_t period    = SAFETY_PERIOD[rate];
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(period));
+    safetyAlive = millis();
+
+    uint32_t now  = micros();
+    int32_t error = (int32_t)(now - last) - period * 1000L;
+    if (last)
+      jitterAdd(&safetyJitter, error < 0 ? -error : error);
+    last = now;
+    safetySample(period, rate == RATE_IDLE);
+
+    // no probe without an open circuit or short to VCC, SCG is ignored like
+    // in getTemp(). One glitch at the idle period must not trip.
+    if (safetyTcError & (PROBE_OC | PROBE_SCV)) {
+      faultMs += period;
+      if (++faults >= SAFETY_FAULT_COUNT && faultMs >= SAFETY_FAULT_TIME)
+        safetyTrip(SAFETY_TC_FAULT);
+      continue;
+    }
+    faultMs = 0;
+    faults  = 0;
+
+    if (safetyTemp > SAFETY_MAX_TEMP)
+      safetyTrip(SAFETY_OVERTEMP);
+    // any healthy probe over the limit is enough, even if it was outvoted
+    for (int i = 0; i < PROBES; i++) {
+      if (probeHealth[i].healthy() && probeSample[i].temp > SAFETY_MAX_TEMP)
+        safetyTrip(SAFETY_OVERTEMP);
+    }
+    if (safetyTInt > SAFETY_MAX_TINT)
+      safetyTrip(SAFETY_TINT);
+
+    // the other zones have a single probe each, either fault cuts them all
+    for (int i = 1; i < ZONES; i++) {
+      if (isnan(zoneTemp[i])) {
+        zoneFaultMs[i] += period;
+        if (++zoneFaults[i] >= SAFETY_FAULT_COUNT &&
+            zoneFaultMs[i] >= SAFETY_FAULT_TIME)
+          safetyTrip(SAFETY_TC_FAULT);
+        continue;
+      }
+      zoneFaultMs[i] = 0;
+      zoneFaults[i]  = 0;
+      if (zoneTemp[i] > SAFETY_MAX_TEMP)
+        safetyTrip(SAFETY_OVERTEMP);
+    }
+
+    // track each commanded relay state, readPower() gives the measured one
+    for (int i = 0; i < ZONES; i++) {
+      bool relay = digitalRead(zones[i].pin);
+      float t    = i ? zoneTemp[i] : safetyTemp;
+      if (isnan(t))
+        continue;
+      if (relay != relayOn[i] || !relayMillis[i]) {
+        relayOn[i]     = relay;
+        relayMillis[i] = millis();
+        relayTemp[i]   = t;
+      }
+      uint32_t since = millis() - relayMillis[i];
+
+      // still heating well after the relay opened, welded contact or wiring
+      if (!relayOn[i] && since > SAFETY_RUNAWAY_DELAY &&
+          t > relayTemp[i] + SAFETY_RUNAWAY_RISE)
+        safetyTrip(SAFETY_RUNAWAY);
+    }
+
+#ifdef S0_PULSE
+    contactorCheck(relayOn[0], millis() - relayMillis[0]);
+#endif
+  }
+}
+
+// Fit the cool-down after the last step and compare it with previous runs,
+// a slow exhaust fan shows up long before the unit reaches 100 degC
+void coolingCheck()
+{
+  static uint32_t start = 0;
+  static uint32_t last  = 0;
+
+  // slow cooling and the free cool-down both count, but only while the
+  // elements stay off: a top-up pulse during slow cooling starts over
+  zone_phase_t phase = zoneViewOf(0).phase;
+  bool after         = phase == ZONE_SLOW_COOL || phase == ZONE_COOLING;
+  if (!after || digitalRead(kiln.pin)) {
+    cooling.reset();
+    start = 0;
+    return;
+  }
+  if (!start) {
+    start = millis();
+    last  = start - COOL_SAMPLE;
+  }
+  if (millis() - last < COOL_SAMPLE)
+    return;
+  last          = millis();
+
+  float minutes = (last - start) / 60000.0f;
+  cooling.add(minutes, temp, tInt);
+
+  if (fanFault || coolingBaseline <= 0 || minutes < COOL_MIN_TIME)
+    return;
+
+  float rate = cooling.rate();
+  if (rate < coolingBaseline * COOL_FAULT_RATIO) {
+    fanFault = true;
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Fan fault? cooling %.4f/min, usual %.4f/min",
+             rate, coolingBaseline);
+    notify(msg, strlen(msg));
+  }
+}
+
+// <user>/f/<hostname>-element, retained so it survives between runs
+void elementPublish()
+{
+  element_run_t trend;
+  bool hasTrend = elementTrend(&elementHistory, &trend);
+  char topic[64];
+  char json[160];
+
+  snprintf(topic, sizeof(topic), "%s/f/%s-element", settings.mqttUser,
+           settings.hostname);
+  int n = snprintf(json, sizeof(json),
+                   "{\"W\":%.0f,\"degKwh\":%.1f,\"trendW\":%.0f,"
+                   "\"trendDegKwh\":%.1f,\"runs\":%u,\"alarm\":%s}",
+                   elementRun.power, elementRun.rise,
+                   hasTrend ? trend.power : 0, hasTrend ? trend.rise : 0,
+                   elementHistory.count, elementAlarm ? "true" : "false");
+  if (n > 0 && (size_t)n < sizeof(json))
+    netPublish(topic, json, n, 1, true);
+}
+
+// Effective element power and degC per kWh over the ramps of a firing,
+// holds only replace losses so they are left out
+void elementCheck()
+{
+  static bool ramping     = false;
+  static bool done        = false;
+  static uint32_t energy0 = 0;
+  static uint32_t onMs    = 0;
+  static uint32_t lastMs  = 0;
+  static float temp0      = 0;
+  static float wh         = 0;
+  static float rise       = 0;
+
+  bool ramp = kiln.ramping() && kiln.step < ZONE_SEGMENTS && !isnan(temp);
+  if (ramp && !ramping) {
+    if (done) { // a new firing, forget the last one
+      done = false;
+      onMs = 0;
+      wh   = 0;
+      rise = 0;
+    }
+    energy0 = energy;
+    temp0   = temp;
+    lastMs  = millis();
+  }
+  if (ramp) {
+    if (digitalRead(kiln.pin))
+      onMs += millis() - lastMs;
+    lastMs = millis();
+  }
+  if (!ramp && ramping) {
+    wh += (energy - energy0) * 0.5f; // 0.5 Wh per S0 pulse
+    rise += temp - temp0;
+  }
+  ramping = ramp;
+
+  if (kiln.step < ZONE_SEGMENTS || done)
+    return;
+  done = true;
+  if (wh < ELEMENT_MIN_WH || !onMs)
+    return;
+
+  elementRun.power = wh / (onMs / 3600000.0f);
+  elementRun.rise  = rise / (wh / 1000.0f);
+  elementHistoryAdd(&elementHistory, elementRun);
+  kiln.watts = elementRun.power; // measured beats the rating for the budget
+
+  element_run_t trend;
+  if (elementTrend(&elementHistory, &trend) &&
+      (elementRun.power < trend.power * ELEMENT_ALARM_RATIO ||
+       elementRun.rise < trend.rise * ELEMENT_ALARM_RATIO)) {
+    elementAlarm = true;
+    char msg[96];
+    snprintf(msg, sizeof(msg),
+             "Element worn? %.0fW %.1f°C/kWh, usual %.0fW %.1f°C/kWh",
+             elementRun.power, elementRun.rise, trend.power, trend.rise);
+    notify(msg, strlen(msg));
+  }
+
+  DBGM(LOG_CONTROL, "Element: %.0fW %.1fdegC/kWh over %.0fWh\n",
+       elementRun.power, elementRun.rise, wh);
+  elementPublish();
+}
+
+// Report new supervisor faults and check the firing as a whole
+void safetyCheck()
+{
+  static uint8_t reported = 0;
+
+  uint8_t fault = safetyFault & ~reported;
+  reported |= fault;
+
+  if (fault) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Safety cut 0x%02X: %.1f°C int %.1f°C", fault,
+             safetyTemp, safetyTInt);
+    notify(msg, strlen(msg));
+  }
+
+  // control follows whichever probe thermoFuse() trusts
+  static int8_t active = 0;
+  if (PROBES > 1 && probeActive != active) {
+    active = probeActive;
+    char msg[64];
+    if (active < 0)
+      snprintf(msg, sizeof(msg), "No healthy probe, health %.2f/%.2f",
+               probeHealth[0].score(), probeHealth[PROBES - 1].score());
+    else
+      snprintf(msg, sizeof(msg), "Probe %d in charge, health %.2f/%.2f",
+               active, probeHealth[0].score(), probeHealth[PROBES - 1].score());
+    notify(msg, strlen(msg));
+  }
+
+  if (fault & (SAFETY_WELDED | SAFETY_OPEN)) {
+    char msg[96];
+    snprintf(msg, sizeof(msg),
+             "%s: relay %s for %ums, %u pulses, last %ums ago",
+             fault & SAFETY_WELDED ? "Welded contactor" : "No power, element/fuse",
+             contactorEvidence.relay ? "on" : "off", contactorEvidence.since,
+             contactorEvidence.pulses, contactorEvidence.lastPulse);
+    notify(msg, strlen(msg));
+  }
+
+  // curtailment stretches the preheat, Zone::preheat() counts at its duty
+  for (int i = 0; i < ZONES; i++) {
+    zone_view_t view = zoneViewOf(i);
+    if (view.preheat > HEAT_TIMEOUT && view.step == 0 &&
+        view.phase == ZONE_RAMP) {
+      char msg[64];
+      snprintf(msg, sizeof(msg),
+               "Zone %d too long to heat, check element/thermostat", i);
+      notify(msg, strlen(msg));
+      controlPost(CONTROL_FINISH << i);
+    }
+  }
+
+  coolingCheck();
+  sampleAdapt();
+  scheduleCheck();
+  standbyCheck();
+
+  // every zone done, nothing left to control
+  bool busy = false;
+  for (int i = 1; i < ZONES; i++)
+    busy |= zoneViewOf(i).active;
+
+  if (temp < 100 && zoneViewOf(0).step == ZONE_DONE && !busy) {
+    static bool learned = false;
+    // a full healthy cool-down refines the baseline for the next run
+    if (!learned && !fanFault &&
+        cooling.samples() >= COOL_MIN_TIME * 60000L / COOL_SAMPLE) {
+      coolingBaseline = coolingBaselineLearn(cooling.rate());
+      DBGM(LOG_SAFETY, "Cooling baseline: %.4f/min\n", coolingBaseline);
+    }
+    learned = true;
+    restart.once_ms(1000, espRestart);
+  }
+}
+
+void printSegments(const Zone &zone)
+{
+  for (size_t i = 0; i < ZONE_SEGMENTS; i++) {
+    DBGM(LOG_CONTROL, "Firing segment %u: {%d,%d,%d}\n", i,
+         zone.segments[i][0], zone.segments[i][1], zone.segments[i][2]);
+  }
+}
+
+void IRAM_ATTR readPower()
 {
   if (energy == 0) {
     // We don't know the time difference between pulse, reset
@@ -638,34 +1878,27 @@ void IRAM_ATTR readPower()
     energyMillis = millis();
   }
 
-  volatile static bool problem = false;
-  if (digitalRead(RELAY)) {
-    if (problem == true) {
-      // notify((char *)"shortError", strlen("shortError"));
-    }
-    problem = true;
-  } else
-    problem = false;
+  portENTER_CRITICAL_ISR(&pulseMux);
+  pulseHistory[pulseCount % PULSE_HISTORY] = energyMillis;
+  pulseCount++;
+  portEXIT_CRITICAL_ISR(&pulseMux);
 }
 
 void getTemp()
 {
-  static float _t   = 0;
-  static uint8_t _s = 0;
-  static bool tErr  = false;
+  static bool tErr = false;
 
-  temp              = thermocouple.readCelsius();
-  tInt              = thermocouple.readInternal();
-  uint8_t error     = thermocouple.readError();
+  // mean of every sample since the last call, however many the rate gave
+  portENTER_CRITICAL(&sampleMux);
+  float sum      = sampleSum;
+  uint32_t count = sampleCount;
+  sampleSum      = 0;
+  sampleCount    = 0;
+  portEXIT_CRITICAL(&sampleMux);
 
-  // average 5x samples
-  _t += temp;
-  _s++;
-  if (_s == 4) {
-    temp = (float)(_t / _s);
-    _t   = 0;
-    _s   = 0;
-  }
+  temp          = count ? sum / count : safetyTemp;
+  tInt          = safetyTInt;
+  uint8_t error = safetyTcError;
 
   // Ignore SCG fault
   // https://forums.adafruit.com/viewtopic.php?f=31&t=169135#p827564
@@ -674,8 +1907,8 @@ void getTemp()
       temp = NAN;
       tErr = true;
 
-      char tcError[24];
-      sprintf(tcError, "Thermocouple error #%i", error);
+      char tcError[32];
+      snprintf(tcError, sizeof(tcError), "Thermocouple error #%i", error);
       notify(tcError, strlen(tcError));
 
       digitalWrite(RELAY, LOW);
@@ -683,141 +1916,131 @@ void getTemp()
   } else {
     static uint32_t log = millis();
     tErr                = false;
-    char msg[8];
-    sprintf(msg, "%.01f", temp);
-
-    struct tm timeinfo;
-    if ((readings.size() == 0) && getLocalTime(&timeinfo)) {
-      time_t epoc = mktime(&timeinfo);
-      epocTime.push_back((long)epoc);
-      readings.push_back(temp);
-      DBG("strlen: %u\n", readings.size());
-      log = millis();
-    } else if (((millis() - log) > (60 * 1000) && controlTimer.active()) &&
-               getLocalTime(&timeinfo)) {
-      time_t epoc = mktime(&timeinfo);
-      epocTime.push_back((long)epoc);
-      readings.push_back(temp);
-      DBG("strlen: %u\n", readings.size());
+    char msg[12];
+    snprintf(msg, sizeof(msg), "%.01f", temp);
+
+    if ((graph.count() == 0) ||
+        ((millis() - log) > (60 * 1000) && kiln.active())) {
+      graph.add(timeUptime(), temp);
+      DBGM(LOG_CONTROL, "strlen: %u\n", graph.count());
       log = millis();
     }
 
-    char instPowerString[8];
-    sprintf(instPowerString, "%.01f", instPower / 1000.0f);
-    events.send(msg, "temperature");
-    events.send(instPowerString, "KW");
-    DBG("T: %sdegC P: %sW\n", msg, instPowerString);
+    char instPowerString[12];
+    snprintf(instPowerString, sizeof(instPowerString), "%.01f",
+             instPower / 1000.0f);
+    netSend(msg, "temperature");
+    netSend(instPowerString, "KW");
+    DBGM(LOG_CONTROL, "T: %sdegC P: %sW\n", msg, instPowerString);
   }
 }
 
-void holdTimer(uint32_t _segment)
+// Display and persistence side of zone 0's program, the others only log
+void zoneEvent(uint8_t zone, zone_event_t e)
 {
-  if (holdMillis == 0) {
-    DBG("Start hold for %dmin\n", _segment);
-    holdMillis = millis();
-    rampTimer.detach();
+  Zone &z = zones[zone];
+
+  if (e != ZONE_EVENT_HOLDING)
+    sampleBoost = millis();
+
+  if (zone) {
+    if (e != ZONE_EVENT_HOLDING)
+      DBGM(LOG_CONTROL, "Zone %u: event %d, step %d\n", zone, e, z.step);
+    return;
+  }
 
+  switch (e) {
+  case ZONE_EVENT_HOLD_START: {
+    DBGM(LOG_CONTROL, "Start hold for %dmin\n", z.segments[z.step][2]);
     lcd.lcdClear();
     lcd.lcdGoToXY(1, 1);
-    lcd.lcdWrite((char *)("Burning: " + String(_segment) + "min").c_str());
+    char line[24];
+    statusLcd(line, sizeof(line), z, e);
+    lcd.lcdWrite(line);
     lcdMenu();
+  } // fall through
+  case ZONE_EVENT_HOLDING:
+    statusInfo(info, sizeof(info), z, e, millis());
+    netSend(info, "display");
+    break;
+  case ZONE_EVENT_STEP:
+    DBGM(LOG_CONTROL, "Done with hold, step: %d\n", z.step);
+    statusInfo(info, sizeof(info), z, e, millis());
+    netSend(info, "display");
+    break;
+  case ZONE_EVENT_SLOW_COOL: {
+    uint8_t h = (millis() - z.initMillis) / (1000 * 3600);
+    uint8_t m = ((millis() - z.initMillis) - (h * 3600 * 1000)) / (60 * 1000);
+    DBGM(LOG_CONTROL, "Reached Temp, after: %d:%d", h, m);
+    statusInfo(info, sizeof(info), z, e, millis());
+    netSend(info, "display");
+    break;
   }
-
-  uint32_t _elapsed = (millis() - holdMillis) / (60 * 1000);
-  info = "Hold: " + String(currentSetpoint, 0) + "°C-" + String(_elapsed) +
-         "/" + String(_segment) + "min";
-  events.send(info.c_str(), "display");
-
-  if (_elapsed >= _segment) {
-    step++;
-    holdMillis = 0;
-    rampTimer.attach_ms(RATEUPDATE * 1000L, rampRate);
-    DBG("Done with hold, step: %d\n", step);
-    info = "Flushing 🔥 @" + String(segments[step][0]) + "°C";
-    events.send(info.c_str(), "display");
-  }
-}
-
-void rampDown()
-{
-  // https://digitalfire.com/schedule/04dsdh
-  if (currentSetpoint < 760 || step == 5) {
-    controlTimer.detach();
-    slowCool.detach();
-    currentSetpoint = 0;
-    tControl();
+  case ZONE_EVENT_COOLING: {
     writeFile(SPIFFS, p_segments, "");
-    info = "Cooling ❄️";
+    statusInfo(info, sizeof(info), z, e, millis());
 
     lcd.lcdClear();
     lcd.lcdGoToXY(1, 1);
-    lcd.lcdWrite((char *)"Cooling");
+    char line[24];
+    statusLcd(line, sizeof(line), z, e);
+    lcd.lcdWrite(line);
     lcdMenu();
 
-    events.send(info.c_str(), "display");
+    netSend(info, "display");
+    break;
+  }
+  default:
+    break;
   }
-
-  currentSetpoint -= (float)(83.0 / (3600.0f / RATEUPDATE));
 }
 
+// Every zone states its heat demand, the arbiter keeps the sum of the
+// closed relays within SITE_POWER_LIMIT
 void tControl()
 {
-  DBG("Control ST: %.01fdegC, step: %d\n", currentSetpoint, step);
-  static uint8_t diff;
-
-  if (!isnan(temp)) {
-    float delta_t = currentSetpoint - temp - diff;
-    if (delta_t >= 0) {
-      if (!digitalRead(RELAY)) {
-        digitalWrite(RELAY, HIGH);
-        // restart timer so relay have time to pulse
-        safetyTimer.detach();
-        safetyTimer.attach_ms(2115L, safetyCheck);
-        diff = 0;
-      }
-    } else if (digitalRead(RELAY)) {
-      digitalWrite(RELAY, LOW);
-      diff = DIFFERENTIAL;
-    }
-    if (step == 5)
-      return;
-    if (temp > segments[step][0]) {
-      currentSetpoint = segments[step][0];
-
-      if (segments[step][2] == -1)
-        segments[step][2] = 0;
-      holdTimer(segments[step][2]);
-
-      if (step == 4) {
-        uint8_t h = (millis() - initMillis) / (1000 * 3600);
-        uint8_t m = ((millis() - initMillis) - (h * 3600 * 1000)) / (60 * 1000);
-        char endInfo[64];
-        sprintf(endInfo, "Reached Temp, after: %d:%d", h, m);
-        DBG("%s", endInfo);
-        info = "Slow Cooling ❄️";
-        events.send(info.c_str(), "display");
-        slowCool.attach_ms(RATEUPDATE * 1000L, rampDown);
-        rampTimer.detach();
-        step++;
-      }
-    }
+  DBGM(LOG_CONTROL, "Control ST: %.01fdegC, step: %d\n", kiln.setpoint,
+       kiln.step);
+
+  for (int i = 0; i < ZONES; i++) {
+    zone_event_t e = zones[i].control(zoneTempOf(i), millis());
+    if (e != ZONE_EVENT_NONE)
+      zoneEvent(i, e);
+  }
+
+  zoneArbitrate(zones, ZONES, SITE_POWER_LIMIT);
+
+  for (int i = 0; i < ZONES; i++) {
+    bool on = zones[i].relay;
+    // checked and switched as one, a trip cannot land in between
+    portENTER_CRITICAL(&safetyMux);
+    on &= !safetyFault;
+    bool changed = on != (bool)digitalRead(zones[i].pin);
+    if (changed)
+      digitalWrite(zones[i].pin, on);
+    portEXIT_CRITICAL(&safetyMux);
+    if (!changed)
+      continue;
+    sampleBoost = millis();
   }
 }
 
 void rampRate()
 {
-  // http://www.stoneware.net/stoneware/glasyrer/firing.htm
-
-  if (currentSetpoint == -9999)
-    currentSetpoint = temp;
+  bool cooling = false;
 
-  if (currentSetpoint >= segments[step][0]) {
-    currentSetpoint = segments[step][0];
-  } else {
-    currentSetpoint += (float)(segments[step][1] / (3600.0f / RATEUPDATE));
+  for (int i = 0; i < ZONES; i++) {
+    zone_event_t e = zones[i].rate();
+    if (e != ZONE_EVENT_NONE)
+      zoneEvent(i, e);
+    cooling |= e == ZONE_EVENT_COOLING;
   }
+  // open the relay of a zone that is done right away
+  if (cooling)
+    tControl();
 
-  DBG("Current Setpoint: %.02fdegC, step: %d\n", currentSetpoint, step);
+  DBGM(LOG_CONTROL, "Current Setpoint: %.02fdegC, step: %d\n", kiln.setpoint,
+       kiln.step);
 }
 
 void readButton()
@@ -847,15 +2070,168 @@ void readButton()
 
   else
     button = 0;
+
+  if (button)
+    powerActivity();
+}
+
+// Ticker callback on PRO_CPU, or any task handing work to controlTask()
+void controlPost(uint32_t work)
+{
+  if (!controlPosted)
+    controlPosted = micros();
+  xTaskNotify(controlHandle, work, eSetBits);
+}
+
+// Publish the zones for the other tasks, controlTask() only
+void zoneViewUpdate()
+{
+  uint32_t now = millis();
+  zone_view_t view[ZONES];
+
+  for (int i = 0; i < ZONES; i++) {
+    view[i].phase    = zones[i].phase();
+    view[i].active   = zones[i].active();
+    view[i].step     = zones[i].step;
+    view[i].setpoint = zones[i].setpoint;
+    view[i].preheat  = zones[i].preheat();
+    view[i].eta      = zones[i].remaining(now);
+    uint32_t full    = zones[i].remaining(now, 1);
+    view[i].delay    = view[i].eta == ZONE_ETA_UNKNOWN ? ZONE_ETA_UNKNOWN
+                       : view[i].eta > full            ? view[i].eta - full
+                                                       : 0;
+  }
+
+  portENTER_CRITICAL(&controlMux);
+  memcpy(zoneView, view, sizeof(zoneView));
+  portEXIT_CRITICAL(&controlMux);
+}
+
+zone_view_t zoneViewOf(uint8_t zone)
+{
+  portENTER_CRITICAL(&controlMux);
+  zone_view_t view = zoneView[zone];
+  portEXIT_CRITICAL(&controlMux);
+  return view;
+}
+
+// Acquisition and control on APP_CPU, of the application tasks only
+// safetyTask() outranks it. Wi-Fi, AsyncTCP and a burst of requests stay on
+// PRO_CPU and cannot delay a relay decision, output goes through netSend().
+void controlTask(void *arg)
+{
+  uint32_t lastRelay = 0;
+
+  for (;;) {
+    uint32_t work;
+    xTaskNotifyWait(0, UINT32_MAX, &work, portMAX_DELAY);
+
+    uint32_t start  = micros();
+    uint32_t posted = controlPosted;
+    controlPosted   = 0;
+    if (posted)
+      jitterAdd(&controlLatency, start - posted);
+
+    // a fresh reading first, the rest decides on it
+    if (work & CONTROL_TEMP)
+      getTemp();
+    if (work & CONTROL_BUTTON)
+      readButton();
+    uint32_t curtailed = 0;
+    if (work & CONTROL_CURTAIL) {
+      portENTER_CRITICAL(&controlMux);
+      uint8_t level = curtailPending;
+      curtailed     = curtailPosted;
+      portEXIT_CRITICAL(&controlMux);
+      curtailSet(level);
+    }
+    // the measured element power beats the rating for the budget
+    if (work & CONTROL_WATTS) {
+      element_run_t trend;
+      if (elementTrend(&elementHistory, &trend))
+        kiln.watts = trend.power;
+    }
+    for (int i = 0; i < ZONES; i++) {
+      if (work & (CONTROL_FIRE << i)) {
+        // static, a program is too big for this stack next to onFire()
+        static char program[SEGMENTS_SIZE];
+        portENTER_CRITICAL(&controlMux);
+        memcpy(program, firePending[i], sizeof(program));
+        portEXIT_CRITICAL(&controlMux);
+        onFire(program, i);
+      }
+      if (work & (CONTROL_FINISH << i))
+        zones[i].finish();
+    }
+    if (work & CONTROL_RAMP)
+      rampRate();
+    if (work & CONTROL_RELAY) {
+      int32_t error = (int32_t)(start - lastRelay) - CONTROL_PERIOD * 1000L;
+      if (lastRelay)
+        jitterAdd(&controlJitter, error < 0 ? -error : error);
+      lastRelay = start;
+      tControl();
+#ifdef S0_PULSE
+      // once per firing it writes NVS, here rather than on esp_timer
+      elementCheck();
+#endif
+    }
+
+    zoneViewUpdate();
+    if (curtailed) {
+      portENTER_CRITICAL(&controlMux);
+      curtailApplied = curtailed;
+      portEXIT_CRITICAL(&controlMux);
+    }
+
+    jitterAdd(&controlRun, micros() - start);
+  }
+}
+
+// Standby once no zone runs and nobody touched the controller for
+// STANDBY_DELAY, the captive portal keeps it awake
+void standbyCheck()
+{
+  bool busy = WiFi.getMode() != WIFI_MODE_STA;
+  for (int i = 0; i < ZONES; i++)
+    busy |= zoneViewOf(i).active || digitalRead(zones[i].pin);
+
+  bool standby = !busy && millis() - activityMillis > STANDBY_DELAY;
+  if (powerStandby(standby))
+    DBG("Standby %s, light sleep %s\n", standby ? "on" : "off",
+        powerLightSleep() ? "yes" : "no");
+
+  // the only place the mode changes, the timers follow it
+  static bool slow = false;
+  if (slow == standby)
+    return;
+  slow = standby;
+  if (buttonTimer.active())
+    buttonTimer.attach_ms(standby ? BUTTON_STANDBY : BUTTON_PERIOD,
+                          controlPost, (uint32_t)CONTROL_BUTTON);
+  if (sendTimer.active())
+    sendTimer.attach_ms(standby ? SEND_STANDBY : SEND_PERIOD, sendData);
 }
 
+// A button, request or message wakes the controller at the next
+// standbyCheck(), within a safetyCheck() period. Called from any task, so
+// it only stamps the time.
+void powerActivity() { activityMillis = millis(); }
+
 void pinInit()
 {
   pinMode(FAN, OUTPUT);
   digitalWrite(FAN, LOW);
 
-  pinMode(RELAY, OUTPUT);
-  digitalWrite(RELAY, LOW);
+  for (int i = 0; i < ZONES; i++) {
+    pinMode(zones[i].pin, OUTPUT);
+    digitalWrite(zones[i].pin, LOW);
+  }
+
+#ifdef S0_PULSE
+  pinMode(S0_PULSE, INPUT_PULLUP);
+  attachInterrupt(S0_PULSE, readPower, FALLING);
+#endif
 
   pinMode(LCD_RST, OUTPUT);
   digitalWrite(LCD_RST, HIGH);
@@ -880,12 +2256,12 @@ void lcdMenu()
 
 void lcdInit()
 {
+  Wire.begin(I2C_SDA, I2C_SCL);
+
   digitalWrite(LCD_RST, LOW);
   delay(500);
   digitalWrite(LCD_RST, HIGH);
 
-  Wire.begin(I2C_SDA, I2C_SCL);
-
   uint16_t lcdID = lcd.getID();
   DBG("getID(): 0x%02X\n", lcdID);
 
@@ -898,11 +2274,116 @@ void lcdInit()
   lcdMenu();
 }
 
-void onMqttConnect(bool sessionPresent) { DBG("Connected to MQTT.\n"); }
+// <user>/f/<hostname>-crash, retained until the next crash replaces it
+void crashPublish()
+{
+  char topic[128];
+  char json[384];
+
+  snprintf(topic, sizeof(topic), "%s/f/%s-crash", settings.mqttUser,
+           settings.hostname);
+  size_t n = crashJson(&crash, json, sizeof(json));
+  if (mqttClient.publish(topic, 1, true, json, n)) {
+    crashMarkReported(&crash);
+    crashPending = false;
+  }
+}
+
+// <user>/f/<hostname>-config takes JSON with the /mqtt.txt keys
+void configTopic(char *topic, size_t size)
+{
+  snprintf(topic, size, "%s/f/%s-config", settings.mqttUser,
+           settings.hostname);
+}
+
+// <user>/f/<hostname>-curtail takes the level in % as plain text
+void curtailTopic(char *topic, size_t size)
+{
+  snprintf(topic, size, "%s/f/%s-curtail", settings.mqttUser,
+           settings.hostname);
+}
+
+// Shed level % of the heater power, 100 pauses every zone. Duty, ramps
+// and holds follow, see Zone::curtail(). controlTask() only.
+void curtailSet(uint8_t level)
+{
+  uint32_t now = millis();
+  curtailLevel = level;
+  for (int i = 0; i < ZONES; i++)
+    zones[i].curtail((100 - level) / 100.0f);
+
+  if (!kiln.active())
+    return;
+  uint32_t eta  = kiln.remaining(now);
+  uint32_t full = kiln.remaining(now, 1);
+  char msg[64];
+  if (eta == ZONE_ETA_UNKNOWN)
+    snprintf(msg, sizeof(msg), "Curtailed %u%%, paused", level);
+  else
+    snprintf(msg, sizeof(msg), "Curtailed %u%%, done in %umin (+%umin)",
+             level, eta / 60, (eta > full ? eta - full : 0) / 60);
+  notify(msg, strlen(msg));
+}
+
+// From any task, returns the number to wait for in curtailApplied
+uint32_t curtailPost(uint8_t level)
+{
+  portENTER_CRITICAL(&controlMux);
+  curtailPending = level > 100 ? 100 : level;
+  uint32_t seq   = ++curtailPosted;
+  portEXIT_CRITICAL(&controlMux);
+  controlPost(CONTROL_CURTAIL);
+  return seq;
+}
+
+// {"level":%,"remaining":s,"delay":s} once controlTask() applied level
+// number seq, null while paused as the program never ends at that level
+size_t curtailFill(uint32_t seq, uint8_t *buffer, size_t maxLen)
+{
+  portENTER_CRITICAL(&controlMux);
+  bool applied     = (int32_t)(curtailApplied - seq) >= 0;
+  zone_view_t view = zoneView[0];
+  portEXIT_CRITICAL(&controlMux);
+  if (!applied)
+    return RESPONSE_TRY_AGAIN;
+
+  char remaining[12], delay[12];
+  snprintf(remaining, sizeof(remaining), "%u", view.eta);
+  snprintf(delay, sizeof(delay), "%u", view.delay);
+  int n = snprintf((char *)buffer, maxLen,
+                   "{\"level\":%u,\"remaining\":%s,\"delay\":%s}",
+                   curtailLevel,
+                   view.eta == ZONE_ETA_UNKNOWN ? "null" : remaining,
+                   view.delay == ZONE_ETA_UNKNOWN ? "null" : delay);
+  return n < 0 ? 0 : min((size_t)n, maxLen - 1);
+}
+
+// <user>/f/<hostname>-fire takes a program like onFire() plus optional
+// "zone" and "at", a unix time to start at
+void fireTopic(char *topic, size_t size)
+{
+  snprintf(topic, size, "%s/f/%s-fire", settings.mqttUser, settings.hostname);
+}
+
+void onMqttConnect(bool sessionPresent)
+{
+  DBGM(LOG_NET, "Connected to MQTT.\n");
+
+  char topic[128];
+  configTopic(topic, sizeof(topic));
+  mqttClient.subscribe(topic, 1);
+  curtailTopic(topic, sizeof(topic));
+  mqttClient.subscribe(topic, 1);
+  fireTopic(topic, sizeof(topic));
+  mqttClient.subscribe(topic, 1);
+
+  if (crashPending)
+    crashPublish();
+}
 
 void onMqttDisconnect(AsyncMqttClientDisconnectReason reason)
 {
-  DBG("Disconnected from MQTT, reason: %u\n", (uint8_t)reason);
+  DBGM(LOG_NET, "Disconnected from MQTT, reason: %u\n", (uint8_t)reason);
 
   if (WiFi.isConnected()) {
     xTimerStart(mqttReconnectTimer, 0);
@@ -911,13 +2392,96 @@ void onMqttDisconnect(AsyncMqttClientDisconnectReason reason)
 
 void connectToMqtt()
 {
-  DBG("Connecting to MQTT...\n");
+  if (!settings.mqttServer[0])
+    return;
+  DBGM(LOG_NET, "Connecting to MQTT...\n");
   mqttClient.connect();
 }
 
+// (Re)connect with the current settings, a live connection is dropped and
+// onMqttDisconnect() reconnects
+void mqttBegin()
+{
+  mqttClient.setServer(settings.mqttServer, settings.mqttPort);
+  mqttClient.setCredentials(settings.mqttUser, settings.mqttPass);
+
+  if (mqttClient.connected())
+    mqttClient.disconnect();
+  else
+    connectToMqtt();
+}
+
+// Persist and apply new settings without a reboot
+void settingsApply(const settings_t &next)
+{
+  bool hostChanged = strcmp(next.hostname, settings.hostname);
+  bool mqttChanged = hostChanged || next.mqttPort != settings.mqttPort ||
+                     strcmp(next.mqttServer, settings.mqttServer) ||
+                     strcmp(next.mqttUser, settings.mqttUser) ||
+                     strcmp(next.mqttPass, settings.mqttPass);
+
+  settings = next;
+  if (!settingsSave(&settings))
+    DBG("Settings not saved\n");
+
+  if (hostChanged) {
+    MDNS.end();
+    MDNS.begin(settings.hostname);
+  }
+  // the config topic follows the hostname, resubscribe too
+  if (mqttChanged)
+    mqttBegin();
+
+  DBG("Settings applied, host: %s mqtt: %s:%u\n", settings.hostname,
+      settings.mqttServer, settings.mqttPort);
+}
+
+void onMqttMessage(char *topic, char *payload,
+                   AsyncMqttClientMessageProperties properties, size_t len,
+                   size_t index, size_t total)
+{
+  char config[128];
+  if (index || len != total)
+    return;
+  powerActivity();
+
+  fireTopic(config, sizeof(config));
+  if (!strcmp(topic, config)) {
+    char program[SEGMENTS_SIZE];
+    size_t n = min(len, sizeof(program) - 1);
+    memcpy(program, payload, n);
+    program[n] = '\0';
+
+    StaticJsonDocument<SEGMENTS_SIZE> doc;
+    if (deserializeJson(doc, program))
+      return;
+    // a zone this controller does not have is dropped
+    fireAt(program, doc["zone"] | 0L, doc["at"] | 0);
+    return;
+  }
+
+  curtailTopic(config, sizeof(config));
+  if (!strcmp(topic, config)) {
+    char level[8];
+    size_t n = min(len, sizeof(level) - 1);
+    memcpy(level, payload, n);
+    level[n] = '\0';
+    curtailPost(constrain(atoi(level), 0, 100));
+    return;
+  }
+
+  configTopic(config, sizeof(config));
+  if (strcmp(topic, config))
+    return;
+
+  settings_t next = settings;
+  if (settingsFromJson(&next, payload, len))
+    settingsApply(next);
+}
+
 void WiFiEvent(WiFiEvent_t event)
 {
-  DBG("[WiFi-event] event: %d\n", event);
+  DBGM(LOG_NET, "[WiFi-event] event: %d\n", event);
   switch (event) {
   case SYSTEM_EVENT_STA_GOT_IP:
     // connectToMqtt();
@@ -926,6 +2490,9 @@ void WiFiEvent(WiFiEvent_t event)
     xTimerStop(mqttReconnectTimer,
                0); // don't reconnect to MQTT while reconnecting WiFi
     break;
+  case SYSTEM_EVENT_SCAN_DONE:
+    scanDone();
+    break;
   default:
     break;
   }
@@ -936,7 +2503,7 @@ void otaInit()
   ArduinoOTA.setHostname("kiln");
 
   ArduinoOTA.onStart([]() {
-    String type;
+    const char *type;
     if (ArduinoOTA.getCommand() == U_FLASH) {
       type = "sketch";
     } else { // U_FS
@@ -944,7 +2511,7 @@ void otaInit()
     }
 
     // NOTE: if updating FS this would be the place to unmount FS using FS.end()
-    Serial.println("Start updating " + type);
+    Serial.printf("Start updating %s\n", type);
   });
   ArduinoOTA.onEnd([]() { Serial.println("\nEnd"); });
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
@@ -968,217 +2535,474 @@ void otaInit()
   ArduinoOTA.begin();
 }
 
-void setup()
+// Prometheus text format, one block of samples per item
+int metricsItem(int item, char *buf, size_t size)
 {
-#ifdef VERBOSE
-  Serial.begin(115200);
-  DBG("VERSION %s\n", FIRMWARE_VERSION);
+  if (item == 0)
+    return snprintf(buf, size,
+                    "# TYPE kiln_temperature_celsius gauge\n"
+                    "kiln_temperature_celsius %.1f\n"
+                    "kiln_internal_temperature_celsius %.1f\n"
+                    "# TYPE kiln_energy_wh_total counter\n"
+                    "kiln_energy_wh_total %.1f\n"
+                    "kiln_step %d\n"
+                    "kiln_safety_fault %u\n"
+                    "kiln_fan_fault %u\n"
+                    "kiln_cooling_rate_baseline %.5f\n",
+                    temp, tInt, energy * 0.5f, zoneViewOf(0).step, safetyFault,
+                    fanFault, coolingBaseline);
+  // the element is measured with the S0 meter only, an empty block without
+  if (item == 1)
+#ifdef S0_PULSE
+    return metricsElement(buf, size, elementRun, &elementHistory,
+                          elementAlarm);
+#else
+    return 0;
 #endif
+  item -= 2;
+  if (item < PROBES)
+    return metricsProbe(buf, size, item, probeSample[item],
+                        probeHealth[item].score());
+  item -= PROBES;
+  if (item < ZONES) {
+    zone_view_t view = zoneViewOf(item);
+    return metricsZone(buf, size, item, zoneTemp[item], view.setpoint,
+                       view.step, digitalRead(zones[item].pin), view.eta);
+  }
+  item -= ZONES;
+  if (item == 0)
+    return snprintf(buf, size,
+                    "kiln_curtail_percent %u\n"
+                    "kiln_sample_period_ms %u\n"
+                    "kiln_standby %u\n"
+                    "kiln_light_sleep %u\n"
+                    "kiln_standby_seconds_total %u\n"
+                    "# HELP kiln_controller_current_estimated_ma From the time "
+                    "in each power mode and datasheet figures, not measured\n"
+                    "kiln_controller_current_estimated_ma %.1f\n"
+                    "kiln_schedule_start %ld\n",
+                    curtailLevel, SAFETY_PERIOD[sampleRate()],
+                    powerInStandby(), powerLightSleep(), powerStandbySeconds(),
+                    powerCurrent(), (long)scheduleAt);
+  if (item == 1)
+    return snprintf(buf, size,
+                    "# HELP kiln_control_latency_us Ticker to control task, "
+                    "across cores\n"
+                    "kiln_control_latency_us %u\n"
+                    "kiln_control_latency_max_us %u\n"
+                    "kiln_control_jitter_max_us %u\n"
+                    "kiln_control_run_max_us %u\n"
+                    "kiln_safety_jitter_max_us %u\n"
+                    "kiln_net_dropped_total %u\n",
+                    controlLatency.last, controlLatency.max, controlJitter.max,
+                    controlRun.max, safetyJitter.max, netDropped);
+  if (item == 2)
+    return snprintf(buf, size,
+                    "kiln_probe_active %d\n"
+                    "kiln_syslog_dropped_total %u\n"
+                    "kiln_log_dropped_total %u\n",
+                    probeActive, PapertrailLogger::dropped(), logDropped());
+  return -1;
+}
 
-  // 1440 samples, every 1 min = 24 hours
-  readings.reserve(1440);
-  epocTime.reserve(1440);
+// Chunked like /scan: whole items only, the rest waits for the next chunk
+size_t metricsFill(int *item, uint8_t *buffer, size_t maxLen)
+{
+  int n = metricsChunk(item, metricsItem, buffer, maxLen);
+  return n < 0 ? RESPONSE_TRY_AGAIN : n;
+}
 
-#ifdef CALIBRATE
-  // Measure GPIO in order to determine Vref to gpio 25 or 26 or 27
-  adc2_vref_to_gpio(GPIO_NUM_25);
-  delay(5000);
-  abort();
-#endif
+// Routes and services once the station is connected
+void stationServer()
+{
+  IPAddress ip = WiFi.localIP();
+  DBGM(LOG_NET, "WiFi Connected, IP: %u.%u.%u.%u\n", ip[0], ip[1], ip[2],
+       ip[3]);
 
-  pinInit();
-  lcdInit();
-  led(RED);
+  timeBegin("CET-1CEST,M3.5.0,M10.5.0/3", "0.pool.ntp.org",
+            "1.pool.ntp.org");
 
-  mqttReconnectTimer =
-      xTimerCreate("mqttTimer", pdMS_TO_TICKS(2000), pdFALSE, (void *)0,
-                   reinterpret_cast<TimerCallbackFunction_t>(connectToMqtt));
+  mqttClient.onConnect(onMqttConnect);
+  mqttClient.onDisconnect(onMqttDisconnect);
+  mqttClient.onMessage(onMqttMessage);
+  mqttBegin();
 
-  WiFi.mode(WIFI_STA);
-  WiFi.onEvent(WiFiEvent);
-  WiFi.begin();
+  MDNS.begin(settings.hostname);
 
-  // Initialize SPIFFS
-  if (!SPIFFS.begin(true)) {
-    DBG("An Error has occurred while mounting SPIFFS\n");
-    return;
-  }
+  server.addHandler(&events);
 
-  // This function does not return so not true if sensor is faulty
-  if (!thermocouple.begin()) {
-    DBG("ERROR.\n");
-  } else
-    DBG("MAX31855 Good\n");
+  events.onConnect([](AsyncEventSourceClient *client) {
+    DBGM(LOG_NET, "Client connected!\n");
+    events.send(info, "display");
+  });
 
-  if (WiFi.waitForConnectResult() == WL_DISCONNECTED ||
-      WiFi.waitForConnectResult() == WL_NO_SSID_AVAIL) { //~ 100 * 100ms
-    DBG("WiFi Failed!: %u\n", WiFi.status());
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendPage(request, &PAGE_INDEX);
+  });
 
-    captiveServer();
+  server.on("/small", HTTP_GET, [](AsyncWebServerRequest *request) {
+    fireRequest(request, "{\"preheat\":{\"st\":550,\"r\":550,\"h\":15}}");
+  });
 
-    WiFi.softAP("myToilet");
+  server.on("/big", HTTP_GET, [](AsyncWebServerRequest *request) {
+    fireRequest(request, "{\"preheat\":{\"st\":550,\"r\":550,\"h\":35}}");
+  });
 
-    server.onNotFound(
-        [](AsyncWebServerRequest *request) { request->redirect("/"); });
-    dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
-    dnsServer.start(53, "*", WiFi.softAPIP());
+  server.on("/fan", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->redirect("/");
+    digitalWrite(FAN, HIGH);
+  });
 
-    DBG("Start Captive Portal at: %s\n", WiFi.softAPIP().toString().c_str());
+  server.on("/abort", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->redirect("/");
+    restart.once_ms(1000, espRestart);
+  });
 
-    server.addHandler(new CaptiveRequestHandler())
-        .setFilter(ON_AP_FILTER); // only when requested from AP
-  } else {
-    DBG("WiFi Connected, IP: %s\n", WiFi.localIP().toString().c_str());
+  server.on("/info", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendPage(request, &PAGE_INFO);
+  });
 
-    configTzTime("CET-1CEST,M3.5.0,M10.5.0/3", "0.pool.ntp.org",
-                 "1.pool.ntp.org");
+  server.on("/config", HTTP_GET, [](AsyncWebServerRequest *request) {
+    char host[sizeof(settings.hostname) * 2];
+    char server[sizeof(settings.mqttServer) * 2];
+    char user[sizeof(settings.mqttUser) * 2];
+    char json[384];
+
+    jsonEscape(host, sizeof(host), settings.hostname);
+    jsonEscape(server, sizeof(server), settings.mqttServer);
+    jsonEscape(user, sizeof(user), settings.mqttUser);
+    // same keys as the MQTT config topic, the password is never sent back
+    snprintf(json, sizeof(json),
+             "{\"version\":%u,\"hostname\":\"%s\",\"s\":\"%s\","
+             "\"port\":%u,\"u\":\"%s\"}",
+             settings.version, host, server, settings.mqttPort, user);
+    request->send(200, "application/json", json);
+  });
 
-    char input[256] = {'\0'};
-    sprintf(input, "%s", readFile(SPIFFS, p_mqtt).c_str());
+  server.on("/config", HTTP_POST, [](AsyncWebServerRequest *request) {
+    settings_t next = settings;
+    settingsFromParams(request, &next);
+    settingsApply(next);
+    request->redirect("/info");
+  });
 
-    StaticJsonDocument<256> doc;
-    DeserializationError error = deserializeJson(doc, input);
+  // /log?net=4&control=2 sets levels per module, see log_level_t
+  server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request) {
+    for (int i = 0; i < request->params(); i++) {
+      AsyncWebParameter *p = request->getParam(i);
+      logSetLevel(p->name().c_str(), atoi(p->value().c_str()));
+    }
+
+    char json[160];
+    int n = snprintf(json, sizeof(json), "{\"dropped\":%u", logDropped());
+    for (int i = 0; i < LOG_MODULE_COUNT && n > 0 && (size_t)n < sizeof(json);
+         i++)
+      n += snprintf(json + n, sizeof(json) - n, ",\"%s\":%u",
+                    LOG_MODULE_NAMES[i], logLevels[i]);
+    if (n > 0 && (size_t)n < sizeof(json))
+      snprintf(json + n, sizeof(json) - n, "}");
+    request->send(200, "application/json", json);
+  });
 
-    if (error) {
-      DBG("deserializeJson() failed: %s\n", error.c_str());
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    int item = 0;
+    request->send(request->beginChunkedResponse(
+        "text/plain; version=0.0.4",
+        [item](uint8_t *buffer, size_t maxLen, size_t index) mutable
+        -> size_t { return metricsFill(&item, buffer, maxLen); }));
+  });
+
+  // summary of the stored core dump, ?erase=1 drops it
+  server.on("/crash", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (request->hasParam("erase")) {
+      crashPending = false;
+      request->send(crashErase() ? 200 : 500, "text/plain", "");
+      return;
+    }
+    crash_t c;
+    if (!crashLoad(&c)) {
+      request->send(404, "text/plain", "no core dump");
       return;
     }
+    char json[384];
+    crashJson(&c, json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
 
-    const char *h = doc["hostname"];
-    const char *u = doc["u"];
-    const char *s = doc["s"];          // "adafruitojdfoisdjfosdijfoi.com"
-    const char *p = doc["pass"];       // "12345678123456781234567812345678"
-    mqtt_port     = atoi(doc["port"]); // 9999
+  // raw image for espcoredump.py
+  server.on("/coredump", HTTP_GET, [](AsyncWebServerRequest *request) {
+    crash_t c;
+    if (!crashLoad(&c)) {
+      request->send(404, "text/plain", "no core dump");
+      return;
+    }
+    size_t size = c.size;
+    request->send(request->beginResponse(
+        "application/octet-stream", size,
+        [size](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+          size_t len = min(maxLen, size - index);
+          return crashRead(index, buffer, len) ? len : 0;
+        }));
+  });
+
+  // ?level=50 sheds half the heater power, 0 lifts it. The reply waits
+  // for controlTask() to apply it.
+  server.on("/curtail", HTTP_GET, [](AsyncWebServerRequest *request) {
+    uint32_t seq = 0;
+    if (request->hasParam("level")) {
+      int level = atoi(request->getParam("level")->value().c_str());
+      seq       = curtailPost(constrain(level, 0, 100));
+    }
+    request->send(request->beginChunkedResponse(
+        "application/json",
+        [seq](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+          return index ? 0 : curtailFill(seq, buffer, maxLen);
+        }));
+  });
 
-    strcpy(mqtt_user, u);
-    strcpy(mqtt_pass, p);
-    strcpy(mqtt_server, s);
+  server.on("/reset", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->redirect("/");
+    restart.once_ms(1000, espRestart);
+  });
 
-    mqttClient.setServer(mqtt_server, 1883);
-    mqttClient.setCredentials(mqtt_user, mqtt_pass);
+  server.on("/update", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendPage(request, &PAGE_UPDATE);
+  });
 
-    mqttClient.onConnect(onMqttConnect);
-    mqttClient.onDisconnect(onMqttDisconnect);
-    connectToMqtt();
+  server.on("/update", HTTP_POST, onUpdate, onUpload);
 
-    MDNS.begin(h);
-    hostname = String(h);
-
-    server.addHandler(&events);
-
-    events.onConnect([](AsyncEventSourceClient *client) {
-      DBG("Client connected!\n");
-      events.send(info.c_str(), "display");
-    });
-
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/html", HTTP_INDEX, processor);
-    });
-
-    server.on("/small", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->redirect("/");
-      onFire("{\"preheat\":{\"st\":550,\"r\":550,\"h\":15}}");
-    });
-
-    server.on("/big", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->redirect("/");
-      onFire("{\"preheat\":{\"st\":550,\"r\":550,\"h\":35}}");
-    });
-
-    server.on("/fan", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->redirect("/");
-      digitalWrite(FAN, HIGH);
-    });
-
-    server.on("/abort", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->redirect("/");
-      restart.once_ms(1000, espRestart);
-    });
-
-    server.on("/info", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/html", HTTP_INFO, processor);
-    });
-
-    server.on("/reset", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->redirect("/");
-      restart.once_ms(1000, espRestart);
-    });
-
-    server.on("/update", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send_P(200, "text/html", HTTP_UPDATE, processor);
-    });
-
-    server.on(
-        "/update", HTTP_POST, [](AsyncWebServerRequest *request) {}, onUpload);
-
-    server.on("/scan", HTTP_GET, [](AsyncWebServerRequest *request) {
-      String json = "[";
-      int n       = WiFi.scanComplete();
-      if (n == WIFI_SCAN_FAILED)
-        WiFi.scanNetworks(false, false, false, 100);
-
-      n = WiFi.scanComplete();
-
-      if (n) {
-        for (int i = 0; i < n; ++i) {
-          if (i)
-            json += ",";
-          json += "{";
-          json += "\"rssi\":" + String(WiFi.RSSI(i));
-          json += ",\"ssid\":\"" + WiFi.SSID(i) + "\"";
-          json += ",\"bssid\":\"" + WiFi.BSSIDstr(i) + "\"";
-          json += ",\"channel\":" + String(WiFi.channel(i));
-          json += ",\"secure\":" + String(WiFi.encryptionType(i));
-          json += "}";
-        }
-        WiFi.scanDelete();
-      }
-      json += "]";
-      Serial.println(json);
-      request->send(200, "application/json", json);
-      json = String();
-    });
+  server.on("/scan", HTTP_GET, [](AsyncWebServerRequest *request) {
+    // answer from the cache right away, refresh it in the background
+    if (!scanMillis || millis() - scanMillis > SCAN_MAX_AGE)
+      scanStart();
 
-    uint16_t lcdID = lcd.getID();
-    DBG("getID(): 0x%02X\n", lcdID);
+    int item = -1;
+    request->send(request->beginChunkedResponse(
+        "application/json", [item](uint8_t *buffer, size_t maxLen,
+                                   size_t index) mutable -> size_t {
+          return scanFill(&item, buffer, maxLen);
+        }));
+  });
 
-    if (lcdID == 0x65) {
-      buttonTimer.attach_ms(500, readButton);
+  sendTimer.attach_ms(SEND_PERIOD, sendData);
+
+  led(GREEN);
+
+  // https://github.com/espressif/arduino-esp32/blob/master/libraries/ESP32/examples/ResetReason/ResetReason.ino
+  esp_reset_reason_t reset_reason = esp_reset_reason();
+  if (reset_reason == ESP_RST_PANIC || reset_reason == ESP_RST_INT_WDT ||
+      reset_reason == ESP_RST_TASK_WDT || reset_reason == ESP_RST_WDT ||
+      reset_reason == ESP_RST_BROWNOUT) {
+    errorLog = new PapertrailLogger(PAPERTRAIL_HOST, PAPERTRAIL_PORT,
+                                    LogLevel::Error, "\033[0;31m",
+                                    "untrol.io", "kiln");
+
+    char rstMsg[12];
+    snprintf(rstMsg, sizeof(rstMsg), "RST= %u", reset_reason);
+    errorLog->printf("%s\n", rstMsg);
+
+    notify(rstMsg, strlen(rstMsg));
+
+    if (crashLoad(&crash) && !crashReported(&crash)) {
+      // Papertrail splits lines at BUFFER_SIZE, so the summary goes in
+      // short lines instead of the JSON the /crash page serves
+      errorLog->printf("crash task %s pc 0x%08x cause %u\n", crash.task,
+                       crash.pc, crash.cause);
+      errorLog->printf("crash vaddr 0x%08x elf %s%s\n", crash.vaddr,
+                       crash.elfSha, crash.corrupted ? " corrupted" : "");
+      for (int i = 0; i < crash.depth; i++) {
+        if (i % 8 == 0)
+          errorLog->print("crash bt");
+        errorLog->printf(" 0x%08x", crash.bt[i]);
+        if (i % 8 == 7 || i + 1 == crash.depth)
+          errorLog->print("\n");
+      }
+      char text[1024];
+      logPrevious(text, sizeof(text));
+      errorLog->print(text);
+      crashPending = true;
     }
 
-    tempTimer.attach(2, getTemp);
-    sendTimer.attach_ms(10000L, sendData);
+    char segmentRecover[SEGMENTS_SIZE];
+    if (readFile(SPIFFS, p_segments, segmentRecover, sizeof(segmentRecover)))
+      firePost(segmentRecover, 0);
+  }
 
-    led(GREEN);
+  server.onNotFound(onRequest);
+}
 
-    // https://github.com/espressif/arduino-esp32/blob/master/libraries/ESP32/examples/ResetReason/ResetReason.ino
-    esp_reset_reason_t reset_reason = esp_reset_reason();
-    if (reset_reason == ESP_RST_PANIC || reset_reason == ESP_RST_INT_WDT ||
-        reset_reason == ESP_RST_TASK_WDT || reset_reason == ESP_RST_WDT ||
-        reset_reason == ESP_RST_BROWNOUT) {
-      errorLog = new PapertrailLogger(PAPERTRAIL_HOST, PAPERTRAIL_PORT,
-                                      LogLevel::Error, "\033[0;31m",
-                                      "untrol.io", "kiln");
+// Captive portal when the stored network could not be joined
+void captivePortal()
+{
+  DBGM(LOG_NET, "WiFi Failed!: %u\n", WiFi.status());
 
-      char rstMsg[12];
-      sprintf(rstMsg, "RST= %u", reset_reason);
-      errorLog->printf("%s\n", rstMsg);
+  captiveServer();
 
-      notify(rstMsg, strlen(rstMsg));
+  WiFi.softAP("myToilet");
 
-      String segmentRecover = readFile(SPIFFS, p_segments);
-      if (segmentRecover.length())
-        onFire(segmentRecover);
-    }
+  server.onNotFound(
+      [](AsyncWebServerRequest *request) { request->redirect("/"); });
+  dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
+  dnsServer.start(53, "*", WiFi.softAPIP());
+
+  IPAddress ip = WiFi.softAPIP();
+  DBGM(LOG_NET, "Start Captive Portal at: %u.%u.%u.%u\n", ip[0], ip[1], ip[2],
+       ip[3]);
+
+  server.addHandler(new CaptiveRequestHandler())
+      .setFilter(ON_AP_FILTER); // only when requested from AP
+}
+
+// Relay off, first thermocouple sample and the safety checks, nothing here
+// may wait on the network or flash
+void bootSafety()
+{
+  bootBegin(BOOT_SAFETY);
+
+  pinInit();
+  led(RED);
 
-    server.onNotFound(onRequest);
+  // This function does not return so not true if sensor is faulty
+  for (int i = 0; i < PROBES; i++) {
+    if (!probes[i]->begin()) {
+      DBGM(LOG_SAFETY, "ERROR.\n");
+    } else
+      DBGM(LOG_SAFETY, "MAX31855 #%d Good\n", i);
+  }
+  for (int i = 1; i < ZONES; i++) {
+    if (!zoneProbes[i]->begin())
+      DBGM(LOG_SAFETY, "Zone %d MAX31855 ERROR.\n", i);
   }
 
-  // otaInit();
+  safetySample(SAFETY_PERIOD[RATE_ACTIVE], false);
+  safetyAlive = millis();
+  zoneViewUpdate();
+  xTaskCreatePinnedToCore(safetyTask, "safety", 3072, NULL, SAFETY_PRIORITY,
+                          NULL, CONTROL_CORE);
+  safetyWatchdog.attach_ms(1000, safetyWatchdogCheck);
+  xTaskCreatePinnedToCore(controlTask, "control", 4096, NULL,
+                          CONTROL_PRIORITY, &controlHandle, CONTROL_CORE);
 
+  getTemp();
+  sampleAdapt();
   safetyTimer.attach_ms(2115L, safetyCheck);
 
+  bootDone(BOOT_SAFETY);
+}
+
+void bootLcd(void *arg)
+{
+  bootBegin(BOOT_LCD);
+
+  lcdInit();
+  if (lcd.getID() == 0x65) {
+    buttonTimer.attach_ms(BUTTON_PERIOD, controlPost,
+                          (uint32_t)CONTROL_BUTTON);
+  }
+
+  bootDone(BOOT_LCD);
+  vTaskDelete(NULL);
+}
+
+void bootStorage(void *arg)
+{
+  bootBegin(BOOT_STORAGE);
+
+  // Initialize SPIFFS
+  if (!SPIFFS.begin(true))
+    DBG("An Error has occurred while mounting SPIFFS\n");
+
+  if (!settingsLoad(&settings)) {
+    // first boot since settings moved to NVS, take over /mqtt.txt
+    char legacy[384];
+    size_t n = readFile(SPIFFS, p_mqtt, legacy, sizeof(legacy));
+    if (n && settingsFromJson(&settings, legacy, n)) {
+      settingsSave(&settings);
+      SPIFFS.remove(p_mqtt);
+      DBG("Settings migrated from %s\n", p_mqtt);
+    }
+  }
+  coolingBaseline = coolingBaselineLoad();
+  elementHistoryLoad(&elementHistory);
+  controlPost(CONTROL_WATTS);
+
+  bootDone(BOOT_STORAGE);
+  vTaskDelete(NULL);
+}
+
+// Wi-Fi joins in the background since setup(), wait for the result here
+// instead of in setup() and bring up the matching services
+void bootNetwork(void *arg)
+{
+  bootBegin(BOOT_NETWORK);
+  uint8_t status = WiFi.waitForConnectResult(); //~ 100 * 100ms
+  bootDone(BOOT_NETWORK);
+
+  // settings for MDNS/MQTT, and the LCD before a recovered firing uses it
+  xEventGroupWaitBits(bootEvents, BIT(BOOT_STORAGE) | BIT(BOOT_LCD), pdFALSE,
+                      pdTRUE, portMAX_DELAY);
+
+  bootBegin(BOOT_SERVICES);
+  assetServer();
+  server.on("/boot", HTTP_GET, [](AsyncWebServerRequest *request) {
+    char json[256];
+    bootJson(json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
+
+  if (status == WL_DISCONNECTED || status == WL_NO_SSID_AVAIL)
+    captivePortal();
+  else
+    stationServer();
+
   server.begin();
+  bootDone(BOOT_SERVICES);
+  vTaskDelete(NULL);
+}
+
+void setup()
+{
+#ifdef VERBOSE
+  Serial.begin(115200);
+  logBegin(&Serial);
+  DBG("VERSION %s\n", FIRMWARE_VERSION);
+#endif
+
+  bootEvents = xEventGroupCreate();
+  netQueue   = xQueueCreate(NET_QUEUE, sizeof(net_msg_t));
+  xTaskCreatePinnedToCore(netTask, "net", 4096, NULL, NET_PRIORITY, NULL,
+                          NET_CORE);
+  bootSafety();
+
+#ifdef CALIBRATE
+  // Measure GPIO in order to determine Vref to gpio 25 or 26 or 27
+  adc2_vref_to_gpio(GPIO_NUM_25);
+  delay(5000);
+  abort();
+#endif
+
+  mqttReconnectTimer =
+      xTimerCreate("mqttTimer", pdMS_TO_TICKS(2000), pdFALSE, (void *)0,
+                   reinterpret_cast<TimerCallbackFunction_t>(connectToMqtt));
+
+  WiFi.mode(WIFI_STA);
+  WiFi.onEvent(WiFiEvent);
+  WiFi.onEvent(provEvent);
+  WiFi.begin();
+
+  xTaskCreate(bootLcd, "bootLcd", 3072, NULL, 1, NULL);
+  xTaskCreate(bootStorage, "bootStorage", 4096, NULL, 1, NULL);
+  xTaskCreate(bootNetwork, "bootNetwork", 8192, NULL, 1, NULL);
+
+  // otaInit();
+
+  esp_ota_img_states_t otaState;
+  if (esp_ota_get_state_partition(esp_ota_get_running_partition(),
+                                  &otaState) == ESP_OK &&
+      otaState == ESP_OTA_IMG_PENDING_VERIFY) {
+    DBG("New firmware, pending verification\n");
+    otaHealthTimer.attach(1, otaHealthCheck);
+  }
 }
 
 void loop()
@@ -1187,4 +3011,7 @@ void loop()
     dnsServer.processNextRequest();
 
   // ArduinoOTA.handle();
+  // the rest runs on Tickers and tasks, a spinning loop would starve the
+  // idle task and with it frequency scaling and light sleep
+  delay(10);
 }
\ No newline at end of file
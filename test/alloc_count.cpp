@@ -0,0 +1,58 @@
+#include "alloc_count.h"
+
+#include <new>
+#include <stdlib.h>
+
+size_t allocCount = 0;
+size_t allocBytes = 0;
+
+static void *counted(void *p, size_t size)
+{
+  allocCount++;
+  allocBytes += size;
+  return p;
+}
+
+#ifdef __GLIBC__
+// glibc lets the program replace malloc(), its own calls from snprintf()
+// and friends included
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) { return counted(__libc_malloc(size), size); }
+
+void *calloc(size_t n, size_t size)
+{
+  return counted(__libc_calloc(n, size), n * size);
+}
+
+void *realloc(void *p, size_t size)
+{
+  return counted(__libc_realloc(p, size), size);
+}
+}
+#endif
+
+void *operator new(size_t size)
+{
+#ifdef __GLIBC__
+  void *p = malloc(size ? size : 1); // counted there
+#else
+  void *p = counted(malloc(size ? size : 1), size);
+#endif
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete[](void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+void operator delete[](void *p, size_t) noexcept { free(p); }
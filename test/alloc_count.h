@@ -0,0 +1,11 @@
+#ifndef __alloc_count_h__
+#define __alloc_count_h__
+
+#include <stddef.h>
+
+// Every operator new in the test binary, and with glibc every malloc(),
+// calloc() and realloc() too, see alloc_count.cpp
+extern size_t allocCount;
+extern size_t allocBytes;
+
+#endif
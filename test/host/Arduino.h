@@ -0,0 +1,4 @@
+// Just enough of Arduino.h for the generated pages on the host
+#ifndef PROGMEM
+#define PROGMEM
+#endif
@@ -0,0 +1,102 @@
+// NVS stand-in for the host: a few fixed slots, no heap, gone on exit
+#ifndef __host_preferences_h__
+#define __host_preferences_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PREFERENCES_SLOTS 8
+#define PREFERENCES_BLOB  256
+
+class Preferences
+{
+  struct slot_t {
+    char key[32]; // namespace/key
+    uint8_t data[PREFERENCES_BLOB];
+    size_t len;
+  };
+
+  static slot_t *slots()
+  {
+    static slot_t s[PREFERENCES_SLOTS];
+    return s;
+  }
+
+  char mNamespace[16];
+  bool mOpen;
+
+  slot_t *find(const char *key, bool create)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "%s/%s", mNamespace, key);
+    slot_t *free = NULL;
+    for (int i = 0; i < PREFERENCES_SLOTS; i++) {
+      if (!strcmp(slots()[i].key, name))
+        return &slots()[i];
+      if (!free && !slots()[i].key[0])
+        free = &slots()[i];
+    }
+    if (!create || !free)
+      return NULL;
+    strcpy(free->key, name);
+    free->len = 0;
+    return free;
+  }
+
+public:
+  Preferences() : mOpen(false) { mNamespace[0] = '\0'; }
+
+  bool begin(const char *name, bool readOnly = false)
+  {
+    (void)readOnly;
+    snprintf(mNamespace, sizeof(mNamespace), "%s", name);
+    mOpen = true;
+    return true;
+  }
+  void end() { mOpen = false; }
+
+  size_t getBytesLength(const char *key)
+  {
+    slot_t *s = mOpen ? find(key, false) : NULL;
+    return s ? s->len : 0;
+  }
+  size_t getBytes(const char *key, void *buf, size_t len)
+  {
+    slot_t *s = mOpen ? find(key, false) : NULL;
+    if (!s || len < s->len)
+      return 0;
+    memcpy(buf, s->data, s->len);
+    return s->len;
+  }
+  size_t putBytes(const char *key, const void *buf, size_t len)
+  {
+    slot_t *s = mOpen && len <= PREFERENCES_BLOB ? find(key, true) : NULL;
+    if (!s)
+      return 0;
+    memcpy(s->data, buf, len);
+    s->len = len;
+    return len;
+  }
+  float getFloat(const char *key, float value = 0)
+  {
+    getBytes(key, &value, sizeof(value));
+    return value;
+  }
+  size_t putFloat(const char *key, float value)
+  {
+    return putBytes(key, &value, sizeof(value));
+  }
+  uint32_t getUInt(const char *key, uint32_t value = 0)
+  {
+    getBytes(key, &value, sizeof(value));
+    return value;
+  }
+  size_t putUInt(const char *key, uint32_t value)
+  {
+    return putBytes(key, &value, sizeof(value));
+  }
+};
+
+#endif
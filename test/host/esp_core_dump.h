@@ -0,0 +1,4 @@
+// Without CONFIG_ESP_COREDUMP_* crashLoad() needs nothing from here
+#ifndef __host_esp_core_dump_h__
+#define __host_esp_core_dump_h__
+#endif
@@ -0,0 +1,40 @@
+// No flash on the host: there is never a coredump partition
+#ifndef __host_esp_partition_h__
+#define __host_esp_partition_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum { ESP_PARTITION_TYPE_DATA = 1 } esp_partition_type_t;
+typedef enum {
+  ESP_PARTITION_SUBTYPE_DATA_COREDUMP = 3
+} esp_partition_subtype_t;
+
+typedef struct {
+  uint32_t size;
+} esp_partition_t;
+
+inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t,
+                                                       esp_partition_subtype_t,
+                                                       const char *)
+{
+  return NULL;
+}
+inline esp_err_t esp_partition_read(const esp_partition_t *, size_t, void *,
+                                    size_t)
+{
+  return ESP_FAIL;
+}
+inline esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t,
+                                           size_t)
+{
+  return ESP_FAIL;
+}
+
+#endif
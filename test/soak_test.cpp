@@ -0,0 +1,307 @@
+// Months of firings on the host through the libraries the firmware runs
+// every cycle: two zones with their probes, the arbiter, status, LCD and
+// notification text, telemetry, the graph and the pages, /metrics, the
+// crash report, element and cooling history. Once booted the heap must not
+// be touched again, operator new and malloc() are counted to prove it.
+//
+//   soak_test [days]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Cooling.h"
+#include "CrashReport.h"
+#include "ElementHealth.h"
+#include "Metrics.h"
+#include "PageTemplate.h"
+#include "StatusText.h"
+#include "Telemetry.h"
+#include "ThermoFusion.h"
+#include "Zone.h"
+#include "alloc_count.h"
+#include "pages_gen.h"
+
+// as in main.cpp
+#define CONTROL_PERIOD 5530 // ms
+#define GRAPH_SAMPLES  1440
+#define INFO_SIZE      48
+#define ZONES          2
+#define PROBES         2
+#define SITE_POWER     3600 // W, less than both elements together
+#define CHUNK          1436
+
+#define DAYS        120      // default soak, millis() wraps twice
+#define FIRING_DAYS 2        // a program starts every other day
+#define EPOCH       1767225600L
+#define AMBIENT     20.0f
+#define HEAT        0.2f     // degC/s with the element on
+#define LOSS        1.56e-4f // per s, of the rise over ambient
+
+static Zone zones[ZONES] = {Zone(26, 3000), Zone(27, 3000)};
+static float zoneTemp[ZONES];
+static uint32_t now; // millis(), wraps every 49.7 days
+static size_t events;
+static GraphRing<GRAPH_SAMPLES> graph;
+static char info[INFO_SIZE];
+static char lcdLine[24];
+static char notice[160];
+static element_history_t elementHistory;
+static element_run_t elementRun;
+static probe_sample_t probeSample[PROBES];
+static ProbeHealth probeHealth[PROBES];
+
+static const int PROGRAM[ZONE_SEGMENTS][3] = {
+    {200, 100, 30}, {600, 150, 0}, {900, 200, 0}, {1000, 150, 20}};
+
+// deterministic noise in [-1, 1]
+static float noise()
+{
+  static uint32_t seed = 1;
+  seed = seed * 1664525u + 1013904223u;
+  return (int32_t)seed / 2147483648.0f;
+}
+
+// renderVar() with the settings a user could type, the platform values
+// are stand-ins of the same shape
+static bool renderVar(uint8_t var, uint32_t item, char *buf, size_t size,
+                      size_t *len)
+{
+  int n;
+  switch (var) {
+  case VAR_GRAPH_DATA:
+    return graph.fill(item, EPOCH, buf, size, len);
+  case VAR_SETTINGS_HOSTNAME:
+    n = htmlEscape(buf, size, "kiln \"<&>\" one");
+    break;
+  case VAR_SETTINGS_SERVER:
+    n = htmlEscape(buf, size, "mqtt.example.org");
+    break;
+  case VAR_HTML_INFO_BOX:
+    n = snprintf(buf, size,
+                 "<strong> Connected</ strong> to %s<br><em><small> with IP "
+                 "%u.%u.%u.%u</small>",
+                 "kiln-net", 192, 168, 1, 42);
+    break;
+  case VAR_UPTIME:
+    n = snprintf(buf, size, "%lu min %lu sec", (unsigned long)now / 60000,
+                 (unsigned long)(now / 1000) % 60);
+    break;
+  default:
+    n = snprintf(buf, size, "%s", TEMPLATE_VAR_NAMES[var]);
+    break;
+  }
+  *len = n < 0 ? 0 : (size_t)n < size ? n : size - 1;
+  return false;
+}
+
+static size_t render(const template_page_t *page)
+{
+  uint8_t chunk[CHUNK];
+  size_t total = 0, n;
+  PageRenderer renderer(page, renderVar);
+  while ((n = renderer.fill(chunk, sizeof(chunk))))
+    total += n;
+  return total;
+}
+
+// Both probes of a zone, the second one flaky now and then
+static float fuse(uint8_t zone, ProbeHealth *health, uint32_t tick)
+{
+  probe_sample_t s[PROBES], out;
+  for (int p = 0; p < PROBES; p++) {
+    s[p].temp  = zoneTemp[zone] + noise() * 0.5f;
+    s[p].tInt  = 25 + noise();
+    s[p].error = 0;
+  }
+  if (tick % 997 == zone) {
+    s[1].temp  = NAN;
+    s[1].error = PROBE_OC;
+  }
+  for (int p = 0; p < PROBES; p++)
+    health[p].update(s[p], &s[1 - p], CONTROL_PERIOD);
+  if (!zone)
+    memcpy(probeSample, s, sizeof(probeSample));
+  thermoFuse(s, health, PROBES, &out);
+  return out.temp;
+}
+
+
+// zoneEvent(): the text every zone 0 event puts on the display and LCD,
+// notify() sends it on
+static void zoneEvent(uint8_t zone, zone_event_t e)
+{
+  size_t n = statusInfo(info, sizeof(info), zones[zone], e, now);
+  statusLcd(lcdLine, sizeof(lcdLine), zones[zone], e);
+  if (n)
+    statusNotify(notice, sizeof(notice), "kiln", info, n);
+  events++;
+}
+
+// metricsItem() over the same blocks, the rest of them are plain numbers
+static int metricsItem(int item, char *buf, size_t size)
+{
+  if (item == 0)
+    return metricsElement(buf, size, elementRun, &elementHistory, false);
+  item--;
+  if (item < PROBES)
+    return metricsProbe(buf, size, item, probeSample[item],
+                        probeHealth[item].score());
+  item -= PROBES;
+  if (item < ZONES)
+    return metricsZone(buf, size, item, zoneTemp[item], zones[item].setpoint,
+                       zones[item].step, zones[item].relay,
+                       zones[item].remaining(now));
+  return -1;
+}
+
+// /metrics in response chunks until the blocks run out
+static size_t scrape()
+{
+  uint8_t chunk[CHUNK];
+  size_t total = 0;
+  int item     = 0, n;
+  while ((n = metricsChunk(&item, metricsItem, chunk, sizeof(chunk))) > 0)
+    total += n;
+  return n < 0 ? 0 : total;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t days = argc > 1 ? atoi(argv[1]) : DAYS;
+
+  // boot: everything the firmware sets up once
+  static ProbeHealth health[ZONES][PROBES];
+  static CoolingFit cooling;
+  static crash_t crash;
+  elementHistoryLoad(&elementHistory);
+  crashLoad(&crash);
+  strcpy(crash.task, "control");
+  crash.pc    = 0x400d1234;
+  crash.depth = CRASH_BT_MAX;
+  for (int i = 0; i < CRASH_BT_MAX; i++)
+    crash.bt[i] = 0x400d0000 + i * 0x40;
+  float baseline = coolingBaselineLoad();
+  for (int i = 0; i < ZONES; i++)
+    zoneTemp[i] = AMBIENT;
+
+  size_t boot      = allocCount;
+  size_t bootBytes = allocBytes;
+  uint32_t rate = 0, firings = 0, finished = 0, pages = 0;
+  size_t telemetryBytes = 0, pageBytes = 0, metricsBytes = 0;
+  uint64_t ms = 0, end = (uint64_t)days * 86400000ULL;
+  float energy = 0, fired0 = 0;
+
+  for (uint32_t tick = 0; ms < end; tick++, ms += CONTROL_PERIOD) {
+    now = (uint32_t)ms;
+
+    // a new program every FIRING_DAYS, zone 1 an hour behind
+    for (int i = 0; i < ZONES; i++) {
+      uint64_t at = FIRING_DAYS * 86400000ULL * (firings / ZONES + 1);
+      if (i == (int)(firings % ZONES) && ms >= at + i * 3600000ULL) {
+        memcpy(zones[i].segments, PROGRAM, sizeof(PROGRAM));
+        zones[i].start(zoneTemp[i], now);
+        if (!i) {
+          statusStart(info, sizeof(info), zones[i]);
+          statusStartLcd(lcdLine, sizeof(lcdLine), zones[i]);
+          // the last cool-down is over, learn from it like coolingCheck()
+          if (cooling.rate() > 0)
+            baseline = coolingBaselineLearn(cooling.rate());
+          cooling.reset();
+          fired0 = energy;
+        }
+        firings++;
+      }
+    }
+
+    // tControl()
+    for (int i = 0; i < ZONES; i++) {
+      float t        = fuse(i, health[i], tick);
+      if (!i)
+        memcpy(probeHealth, health[0], sizeof(probeHealth));
+      zone_event_t e = zones[i].control(t, now);
+      if (e != ZONE_EVENT_NONE)
+        zoneEvent(i, e);
+    }
+    zoneArbitrate(zones, ZONES, SITE_POWER);
+
+    // the kiln itself
+    for (int i = 0; i < ZONES; i++) {
+      float dt = CONTROL_PERIOD / 1000.0f;
+      zoneTemp[i] += ((zones[i].relay ? HEAT : 0) -
+                      LOSS * (zoneTemp[i] - AMBIENT)) * dt;
+      if (zones[i].relay)
+        energy += zones[i].watts * dt / 3600.0f;
+    }
+
+    // rampRate(), the graph and telemetry once a minute
+    if (ms / (ZONE_RATE_PERIOD * 1000ULL) == rate)
+      continue;
+    rate = ms / (ZONE_RATE_PERIOD * 1000ULL);
+
+    for (int i = 0; i < ZONES; i++) {
+      zone_event_t e = zones[i].rate();
+      if (e != ZONE_EVENT_NONE)
+        zoneEvent(i, e);
+      if (i || e != ZONE_EVENT_COOLING)
+        continue;
+      // zone 0 done: record the run like elementCheck()
+      elementRun.power      = 3000;
+      elementRun.rise  = (PROGRAM[3][0] - AMBIENT) /
+                         ((energy - fired0) / 1000.0f);
+      elementHistoryAdd(&elementHistory, elementRun);
+      element_run_t trend;
+      elementTrend(&elementHistory, &trend);
+      finished++;
+    }
+    if (zones[0].phase() == ZONE_COOLING)
+      cooling.add(rate, zoneTemp[0], AMBIENT);
+
+    graph.add(ms / 1000, zoneTemp[0]);
+
+    telemetry_t t = {};
+    t.temp        = zoneTemp[0];
+    t.energy      = (uint32_t)energy;
+    t.setpoint    = zones[0].setpoint;
+    t.step        = zones[0].step;
+    t.eta         = zones[0].remaining(now);
+    uint8_t buf[192];
+    size_t n = telemetryEncode(t, TELEMETRY_JSON, buf, sizeof(buf));
+    if (!n) {
+      printf("telemetry did not fit\n");
+      return 1;
+    }
+    telemetryBytes += n;
+
+    // Prometheus scrapes every minute
+    size_t m = scrape();
+    if (!m) {
+      printf("metrics did not fit\n");
+      return 1;
+    }
+    metricsBytes += m;
+
+    // someone opens the pages every few hours, the crash report with them
+    if (rate % 180 == 0) {
+      char json[1024];
+      pageBytes += render(&PAGE_INDEX) + render(&PAGE_INFO);
+      pageBytes += crashJson(&crash, json, sizeof(json));
+      pages++;
+    }
+  }
+
+  size_t allocs = allocCount - boot;
+  size_t bytes  = allocBytes - bootBytes; // before printf() buffers stdout
+  printf("%u days, %u firings, %u finished, %zu events, %u pages, "
+         "%zu B telemetry, %zu B metrics, %zu B pages, baseline %.5f\n",
+         days, firings, finished, events, pages, telemetryBytes, metricsBytes,
+         pageBytes, baseline);
+  printf("allocations after boot: %zu (%zu B)\n", allocs, bytes);
+
+  // every program ran to the end and nothing was allocated doing it
+  if (allocs || !pages || finished + 1 < firings / ZONES || baseline <= 0) {
+    printf("FAILED\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+// Payload size and encode time of each telemetry format, and of the
+// StaticJsonDocument path sendData() used before when ArduinoJson is given
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "Telemetry.h"
+
+#ifdef HAVE_ARDUINOJSON
+#include "ArduinoJson.h"
+#endif
+
+#define ROUNDS 200000
+
+static telemetry_t sample()
+{
+  telemetry_t t;
+  t.temp     = 523.25f;
+  t.current  = 13.04f;
+  t.power    = 3.0f;
+  t.energy   = 48211;
+  t.cost     = 14.46f;
+  t.tInt     = 41.5f;
+  t.setpoint = 550;
+  t.step     = 2;
+  t.rssi     = -67;
+  t.eta      = 5400;
+  t.curtail  = 0;
+  return t;
+}
+
+static double nsPerRound(std::chrono::steady_clock::time_point start)
+{
+  std::chrono::duration<double, std::nano> d =
+      std::chrono::steady_clock::now() - start;
+  return d.count() / ROUNDS;
+}
+
+#ifdef HAVE_ARDUINOJSON
+// sendData() before the schema, same keys and values
+static size_t legacyEncode(const telemetry_t &t, char *payload, size_t size)
+{
+  StaticJsonDocument<192> doc;
+  JsonObject feeds = doc.createNestedObject("feeds");
+  feeds["T"]       = t.temp;
+  feeds["I"]       = t.current;
+  feeds["P"]       = t.power;
+  feeds["E"]       = t.energy;
+  feeds["$"]       = t.cost;
+  feeds["Tint"]    = t.tInt;
+  feeds["St"]      = t.setpoint;
+  feeds["Step"]    = t.step;
+  feeds["RSSI"]    = t.rssi;
+  feeds["ETA"]     = t.eta;
+  feeds["Cut"]     = t.curtail;
+  return serializeJson(doc, payload, size);
+}
+#endif
+
+int main()
+{
+  static const char *const NAMES[] = {"json", "cbor", "msgpack"};
+  static const char EXPECTED[] =
+      "{\"feeds\":{\"T\":523.25,\"I\":13.04,\"P\":3,\"E\":48211,\"$\":14.46,"
+      "\"Tint\":41.5,\"St\":550,\"Step\":2,\"RSSI\":-67,\"ETA\":5400,"
+      "\"Cut\":0}}";
+
+  telemetry_t t = sample();
+  uint8_t buf[224];
+  volatile size_t sink = 0;
+  int failed           = 0;
+
+  size_t len = telemetryEncode(t, TELEMETRY_JSON, buf, sizeof(buf));
+  if (len != strlen(EXPECTED) || memcmp(buf, EXPECTED, len)) {
+    printf("json mismatch: %.*s\n", (int)len, buf);
+    failed = 1;
+  }
+  // {"feeds":{11 pairs..}}, fixmap only while there are 15 fields or less
+  static const uint8_t MSGPACK_HEAD[] = {0x81, 0xA5, 'f', 'e', 'e', 'd', 's',
+                                         TELEMETRY_FIELD_COUNT > 15 ? 0xDE
+                                         : 0x80 | TELEMETRY_FIELD_COUNT};
+  len = telemetryEncode(t, TELEMETRY_MSGPACK, buf, sizeof(buf));
+  if (len < sizeof(MSGPACK_HEAD) ||
+      memcmp(buf, MSGPACK_HEAD, sizeof(MSGPACK_HEAD))) {
+    printf("msgpack map header mismatch\n");
+    failed = 1;
+  }
+  // too small a buffer reports 0, never a truncated payload
+  if (telemetryEncode(t, TELEMETRY_CBOR, buf, 16)) {
+    printf("cbor overflow not reported\n");
+    failed = 1;
+  }
+
+  printf("%-12s %8s %10s\n", "format", "bytes", "ns/encode");
+  for (int f = TELEMETRY_JSON; f <= TELEMETRY_MSGPACK; f++) {
+    len        = telemetryEncode(t, (telemetry_format_t)f, buf, sizeof(buf));
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+      t.temp = 500 + (i & 63);
+      sink += telemetryEncode(t, (telemetry_format_t)f, buf, sizeof(buf));
+    }
+    printf("%-12s %8zu %10.0f\n", NAMES[f], len, nsPerRound(start));
+    if (!len)
+      failed = 1;
+  }
+
+#ifdef HAVE_ARDUINOJSON
+  char payload[192];
+  t          = sample();
+  len        = legacyEncode(t, payload, sizeof(payload));
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    t.temp = 500 + (i & 63);
+    sink += legacyEncode(t, payload, sizeof(payload));
+  }
+  printf("%-12s %8zu %10.0f\n", "arduinojson", len, nsPerRound(start));
+#else
+  printf("arduinojson: configure with -DARDUINOJSON_DIR=<ArduinoJson/src> to "
+         "compare\n");
+#endif
+
+  return failed;
+}
@@ -0,0 +1,204 @@
+// Render time and allocations per page: PageRenderer against the
+// AsyncWebServer template processor with a String per placeholder it
+// replaced. Host values stand in for WiFi/ESP calls, formats match
+// renderVar() in main.cpp.
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+#include "StatusText.h"
+#include "alloc_count.h"
+#include "pages_gen.h"
+
+#define GRAPH_SAMPLES 1440
+#define CHUNK         1436 // one TCP segment, what AsyncWebServer asks for
+#define ROUNDS        200
+#define EPOCH         1767225600L
+
+static float readings[GRAPH_SAMPLES];
+static long epochs[GRAPH_SAMPLES];
+static GraphRing<GRAPH_SAMPLES> graph; // the same samples, as main.cpp has them
+static volatile uint8_t sink;
+
+// A full chunk handed to the socket
+static void sent(const uint8_t *chunk, size_t n) { sink ^= chunk[n - 1]; }
+
+static bool renderVar(uint8_t var, uint32_t item, char *buf, size_t size,
+                      size_t *len)
+{
+  int n = 0;
+
+  switch (var) {
+  case VAR_HTML_INFO_BOX:
+    n = snprintf(buf, size,
+                 "<strong> Connected</ strong> to %s<br><em><small> with IP "
+                 "%u.%u.%u.%u</small>",
+                 "workshop", 192, 168, 1, 42);
+    break;
+  case VAR_UPTIME:
+    n = snprintf(buf, size, "%lu min %lu sec", 8153UL, 12UL);
+    break;
+  case VAR_SKETCH_INFO:
+    n = snprintf(buf, size, "%u / %u<br><progress value=\"%u\" max=\"%u\">",
+                 1123456u, 1966080u, 1123456u, 1966080u);
+    break;
+  case VAR_MY_MAC:
+    n = snprintf(buf, size, "%02X:%02X:%02X:%02X:%02X:%02X", 0x24, 0x0A, 0xC4,
+                 0x12, 0x34, 0x56);
+    break;
+  case VAR_GRAPH_DATA:
+    return graph.fill(item, EPOCH, buf, size, len);
+  default:
+    n = snprintf(buf, size, "%s", TEMPLATE_VAR_NAMES[var]);
+    break;
+  }
+
+  *len = n;
+  return false;
+}
+
+// processor() before the pre-split pages, one comparison per name
+static std::string processor(const std::string &var)
+{
+  // the names processor() knew first, then the ones added since
+  static const char *const ORDER[] = {
+      "CSS_TEMPLATE",      "INDEX_JS",        "HTML_HEAD_TITLE",
+      "HTML_INFO_BOX",     "UPTIME",          "CHIP_ID",
+      "FREE_HEAP",         "SKETCH_INFO",     "HOSTNAME",
+      "MY_MAC",            "MY_RSSI",         "FW_VER",
+      "SDK_VER",           "ABOUT_DATE",      "ASSET_VER",
+      "PROV_TIMEOUT",      "BOOT_PROFILE",    "SETTINGS_HOSTNAME",
+      "SETTINGS_SERVER",   "SETTINGS_PORT",   "SETTINGS_USER"};
+  for (const char *name : ORDER) {
+    if (var == name) {
+      char buf[TEMPLATE_ITEM_MAX];
+      size_t len;
+      renderVar(templateVar(name), 0, buf, sizeof(buf), &len);
+      return std::string(buf, len);
+    }
+  }
+  if (var == "GRAPH_DATA") {
+    std::string graph = "[";
+    for (size_t i = 0; i < GRAPH_SAMPLES; i++) {
+      graph += i ? ",[" : "[";
+      graph += std::to_string(epochs[i]);
+      graph += ",";
+      char value[16]; // String(readings[i], 0)
+      snprintf(value, sizeof(value), "%.0f", readings[i]);
+      graph += value;
+      graph += "]";
+    }
+    return graph + "]";
+  }
+  return std::string();
+}
+
+// The page as it was in flash, %NAME% and all, a literal % is %%
+static std::string source(const template_page_t &page)
+{
+  std::string s;
+  for (uint16_t i = 0; i < page.count; i++) {
+    for (uint16_t c = 0; c < page.segments[i].len; c++) {
+      if (page.segments[i].text[c] == '%')
+        s += '%';
+      s += page.segments[i].text[c];
+    }
+    if (page.segments[i].var != TEMPLATE_VAR_NONE)
+      s += std::string("%") + TEMPLATE_VAR_NAMES[page.segments[i].var] + "%";
+  }
+  return s;
+}
+
+// AsyncWebServer's template pass: every %NAME% goes through processor()
+static size_t legacyRender(const std::string &src)
+{
+  uint8_t chunk[CHUNK];
+  size_t n = 0, total = 0;
+
+  for (size_t i = 0; i < src.size();) {
+    size_t end;
+    std::string out;
+    if (src[i] == '%' && (end = src.find('%', i + 1)) != std::string::npos) {
+      out = end == i + 1 ? "%" : processor(src.substr(i + 1, end - i - 1));
+      i   = end + 1;
+    } else
+      out = src[i++];
+
+    for (char c : out) {
+      chunk[n++] = c;
+      if (n == CHUNK) {
+        sent(chunk, n);
+        total += n;
+        n = 0;
+      }
+    }
+  }
+  if (n)
+    sent(chunk, n);
+  return total + n;
+}
+
+static size_t render(const template_page_t *page)
+{
+  uint8_t chunk[CHUNK];
+  size_t total = 0, n;
+  PageRenderer renderer(page, renderVar);
+  while ((n = renderer.fill(chunk, sizeof(chunk)))) {
+    sent(chunk, n);
+    total += n;
+  }
+  return total;
+}
+
+int main()
+{
+  static const struct {
+    const char *name;
+    const template_page_t *page;
+  } PAGES[] = {{"index", &PAGE_INDEX},
+               {"info", &PAGE_INFO},
+               {"config", &PAGE_CONFIG}};
+
+  for (int i = 0; i < GRAPH_SAMPLES; i++) {
+    epochs[i]   = EPOCH + i * 60;
+    readings[i] = 20 + i * 0.4f;
+    graph.add(i * 60, readings[i]);
+  }
+
+  int failed = 0;
+  printf("%-8s %8s %12s %10s %12s %10s\n", "page", "bytes", "legacy us",
+         "allocs", "renderer us", "allocs");
+  for (const auto &p : PAGES) {
+    std::string src = source(*p.page);
+
+    size_t allocs = allocCount;
+    size_t legacy = legacyRender(src);
+    size_t legacyAllocs = allocCount - allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+      legacyRender(src);
+    std::chrono::duration<double, std::micro> legacyTime =
+        std::chrono::steady_clock::now() - start;
+
+    allocs              = allocCount;
+    size_t bytes        = render(p.page);
+    size_t renderAllocs = allocCount - allocs;
+    start               = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+      render(p.page);
+    std::chrono::duration<double, std::micro> renderTime =
+        std::chrono::steady_clock::now() - start;
+
+    printf("%-8s %8zu %12.1f %10zu %12.1f %10zu\n", p.name, bytes,
+           legacyTime.count() / ROUNDS, legacyAllocs,
+           renderTime.count() / ROUNDS, renderAllocs);
+
+    // same page either way, and the renderer never touches the heap
+    if (bytes != legacy || renderAllocs) {
+      printf("%s: %zu bytes vs %zu, %zu allocations\n", p.name, bytes, legacy,
+             renderAllocs);
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,189 @@
+"""
+build_assets.py
+Minify and gzip the static web assets in ./web into include/assets_gz.h and
+pre-split the HTML templates into include/pages_gen.h
+
+Runs as a PlatformIO pre script (extra_scripts = pre:tools/build_assets.py)
+or standalone: python tools/build_assets.py
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+# (source, symbol, content type)
+ASSETS = [
+    ("app.css", "APP_CSS", "text/css"),
+    ("app.js", "APP_JS", "application/javascript"),
+]
+
+# (source, symbol) rendered per request by PageRenderer
+PAGES = [
+    ("config.html", "PAGE_CONFIG"),
+    ("index.html", "PAGE_INDEX"),
+    ("info.html", "PAGE_INFO"),
+    ("provision.html", "PAGE_PROVISION"),
+    ("update.html", "PAGE_UPDATE"),
+]
+
+PLACEHOLDER = re.compile(r"%([A-Z][A-Z0-9_]*)%|%%")
+
+
+def minify_css(src):
+    src = re.sub(r"/\*.*?\*/", "", src, flags=re.S)
+    src = re.sub(r"\s+", " ", src)
+    src = re.sub(r"\s*([{}:;,>])\s*", r"\1", src)
+    return src.replace(";}", "}").strip()
+
+
+def minify_js(src):
+    # Conservative: drop comment-only lines, indentation and blank lines.
+    # Newlines are kept so automatic semicolon insertion still holds.
+    out = []
+    for line in src.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        out.append(line)
+    return "\n".join(out)
+
+
+def minify_html(src):
+    return "\n".join(l.strip() for l in src.splitlines() if l.strip())
+
+
+MINIFY = {".css": minify_css, ".js": minify_js}
+
+
+def c_string(text):
+    out = []
+    for b in text.encode("utf-8"):
+        c = chr(b)
+        if c in "\\\"":
+            out.append("\\" + c)
+        elif c == "\n":
+            out.append("\\n")
+        elif 0x20 <= b < 0x7F and c != "?":
+            out.append(c)
+        else:
+            # octal, unlike \x it never swallows the following characters
+            out.append("\\%03o" % b)
+    return "\"%s\"" % "".join(out)
+
+
+def split_template(src):
+    """[(literal, placeholder or None), ...], %% is a literal %"""
+    segments, literal, pos = [], "", 0
+    for m in PLACEHOLDER.finditer(src):
+        literal += src[pos:m.start()]
+        pos = m.end()
+        if m.group(1) is None:
+            literal += "%"
+            continue
+        segments.append((literal, m.group(1)))
+        literal = ""
+    literal += src[pos:]
+    if literal:
+        segments.append((literal, None))
+    return segments
+
+
+def write_if_changed(path, content):
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as f:
+            if f.read() == content:
+                return
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(content)
+
+
+def build_pages(web_dir, out_path):
+    lines = [
+        "// Generated by tools/build_assets.py from ./web - do not edit",
+        "#include \"Arduino.h\"",
+        "#include \"template_vars.h\"",
+        "",
+    ]
+
+    for name, symbol in PAGES:
+        with open(os.path.join(web_dir, name), encoding="utf-8") as f:
+            segments = split_template(minify_html(f.read()))
+
+        for var in sorted(set(v for _, v in segments if v)):
+            lines.append(
+                "static_assert(templateVar(\"%s\") != TEMPLATE_VAR_NONE, "
+                "\"web/%s: %%%s%% is not in TEMPLATE_VARS\");" % (var, name, var))
+
+        table = []
+        for i, (literal, var) in enumerate(segments):
+            lines.append("const char %s_%d[] PROGMEM = %s;" %
+                         (symbol, i, c_string(literal)))
+            table.append("  {%s_%d, %d, %s}," % (
+                symbol, i, len(literal.encode("utf-8")),
+                "templateVar(\"%s\")" % var if var else "TEMPLATE_VAR_NONE"))
+
+        lines += [
+            "const template_segment_t %s_SEGMENTS[] PROGMEM = {" % symbol,
+        ] + table + [
+            "};",
+            "const template_page_t %s = {%s_SEGMENTS, %d};" %
+            (symbol, symbol, len(segments)),
+            "",
+        ]
+        print("build_assets: %s %d segments" % (name, len(segments)))
+
+    write_if_changed(out_path, "\n".join(lines))
+
+
+def c_array(data):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]))
+    return ",\n".join(rows)
+
+
+def build(project_dir):
+    web_dir = os.path.join(project_dir, "web")
+    out_path = os.path.join(project_dir, "include", "assets_gz.h")
+
+    lines = [
+        "// Generated by tools/build_assets.py from ./web - do not edit",
+        "#include \"Arduino.h\"",
+        "",
+    ]
+    version = hashlib.sha256()
+
+    for name, symbol, content_type in ASSETS:
+        with open(os.path.join(web_dir, name), encoding="utf-8") as f:
+            src = f.read()
+        minified = MINIFY[os.path.splitext(name)[1]](src).encode("utf-8")
+        # mtime=0 keeps the output, and so the ETag, reproducible
+        packed = gzip.compress(minified, compresslevel=9, mtime=0)
+        digest = hashlib.sha256(minified).hexdigest()
+        version.update(minified)
+
+        lines += [
+            "const uint8_t %s_GZ[] PROGMEM = {\n%s};" % (symbol, c_array(packed)),
+            "const size_t %s_GZ_LEN = %d;" % (symbol, len(packed)),
+            "const char %s_ETAG[] = \"\\\"%s\\\"\";" % (symbol, digest[:16]),
+            "const char %s_TYPE[] = \"%s\";" % (symbol, content_type),
+            "",
+        ]
+        print("build_assets: %s %d -> %d -> %d bytes" %
+              (name, len(src), len(minified), len(packed)))
+
+    # cache busting query appended to asset URLs in the pages
+    lines.append("const char ASSET_VER[] = \"%s\";" % version.hexdigest()[:8])
+    lines.append("")
+
+    write_if_changed(out_path, "\n".join(lines))
+    build_pages(web_dir, os.path.join(project_dir, "include", "pages_gen.h"))
+
+
+try:
+    Import("env")  # noqa: F821
+    build(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    build(os.path.dirname(os.path.dirname(os.path.abspath(sys.argv[0]))))
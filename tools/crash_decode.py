@@ -0,0 +1,83 @@
+"""
+crash_decode.py
+Resolve the crash summary from /crash (or the retained <user>/f/<host>-crash
+MQTT message) to functions and source lines of the firmware ELF.
+
+  python tools/crash_decode.py .pio/build/esp32/firmware.elf http://kiln.local/crash
+  python tools/crash_decode.py .pio/build/esp32/firmware.elf crash.json
+
+The ELF must be the build that crashed, compare "elf" in the summary with
+the start of its app ELF SHA-256. For the task list and registers fetch the
+whole image from /coredump and hand it to espcoredump.py:
+
+  curl -o core.bin http://kiln.local/coredump
+  espcoredump.py info_corefile -t raw -c core.bin .pio/build/esp32/firmware.elf
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+ADDR2LINE = "xtensa-esp32-elf-addr2line"
+TOOLCHAIN = os.path.join("~", ".platformio", "packages",
+                         "toolchain-xtensa-esp32", "bin")
+
+# Xtensa EXCCAUSE values seen on the ESP32
+CAUSES = {
+    0: "IllegalInstruction",
+    2: "InstructionFetchError",
+    3: "LoadStoreError",
+    6: "IntegerDivideByZero",
+    9: "LoadStoreAlignment",
+    20: "InstFetchProhibited",
+    28: "LoadProhibited",
+    29: "StoreProhibited",
+}
+
+
+def addr2line():
+    path = shutil.which(ADDR2LINE)
+    if not path:
+        path = os.path.join(os.path.expanduser(TOOLCHAIN), ADDR2LINE)
+        if not shutil.which(path):
+            raise SystemExit("%s not found, add the toolchain to PATH" % ADDR2LINE)
+    return path
+
+
+def load(source):
+    if source.startswith(("http://", "https://")):
+        from urllib.request import urlopen
+        with urlopen(source, timeout=10) as r:
+            return json.load(r)
+    with open(source, encoding="utf-8") as f:
+        return json.load(f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[2])
+    parser.add_argument("elf")
+    parser.add_argument("crash", help="summary JSON file or /crash URL")
+    args = parser.parse_args()
+
+    crash = load(args.crash)
+    cause = crash.get("cause", -1)
+    print("task %s, %s (%d) at %s, EXCVADDR %s, firmware %s" % (
+        crash.get("task", "?"), CAUSES.get(cause, "exception"), cause,
+        crash.get("pc", "?"), crash.get("vaddr", "?"), crash.get("elf", "?")))
+    if crash.get("corrupted"):
+        print("backtrace is corrupted, the last frames are unreliable")
+
+    # the backtrace starts at the faulting PC
+    addrs = crash.get("bt") or [crash["pc"]]
+    # -p one line per address, -f function, -i inlined callers, -a address
+    out = subprocess.run([addr2line(), "-pfiaC", "-e", args.elf] + addrs,
+                         stdout=subprocess.PIPE, universal_newlines=True,
+                         check=True)
+    sys.stdout.write(out.stdout)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,192 @@
+"""
+delta_patch.py
+Build a delta firmware update against the image currently on the device.
+
+  python tools/delta_patch.py old.bin new.bin update.kdlt
+  python tools/delta_patch.py --apply old.bin update.kdlt out.bin
+
+Upload the .kdlt file on /update like a normal image, the device rebuilds the
+new image from its running partition while it streams into the other slot.
+
+Format, all integers little endian:
+  "KDLT" | u8 version | 3 x u8 reserved | u32 new size
+  | 32 B SHA-256 of the new image | 32 B app ELF SHA-256 of the old image
+  | raw deflate stream of operations until new size bytes are produced:
+      varint extra_len, zigzag varint seek, varint diff_len,
+      extra_len literal bytes, diff_len bytes added to the old image
+  The old cursor moves by seek before the diff bytes and by diff_len after.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"KDLT"
+VERSION = 1
+HEADER = struct.Struct("<4sB3xI32s32s")
+
+# esp_image_header_t (24) + esp_image_segment_header_t (8), then
+# esp_app_desc_t whose app_elf_sha256 sits at offset 144
+APP_ELF_SHA_OFFSET = 24 + 8 + 144
+
+KEY = 12     # bytes hashed to find a candidate match in the old image
+SLACK = 256  # stop extending a match after this many bytes without gain
+
+
+def varint(v):
+    out = bytearray()
+    while True:
+        b = v & 0x7F
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def zigzag(v):
+    return (v << 1) ^ (v >> 63)
+
+
+def elf_sha(image):
+    return image[APP_ELF_SHA_OFFSET:APP_ELF_SHA_OFFSET + 32]
+
+
+def match_length(old, new, o, n):
+    best_len = best_gain = gain = 0
+    i = 0
+    limit = min(len(old) - o, len(new) - n)
+    while i < limit:
+        # a matching byte diffs to zero and compresses to nothing
+        gain += 1 if old[o + i] == new[n + i] else -1
+        i += 1
+        if gain > best_gain:
+            best_gain, best_len = gain, i
+        elif i - best_len > SLACK:
+            break
+    return best_len
+
+
+def diff(old, new):
+    index = {}
+    for i in range(len(old) - KEY, -1, -1):
+        index[old[i:i + KEY]] = i
+
+    ops = []
+    old_pos = 0   # old cursor after the previous operation
+    lit_start = 0
+    n = 0
+    while n < len(new):
+        key = new[n:n + KEY]
+        if len(key) < KEY:
+            break
+        # prefer the current alignment, small edits keep code in place
+        guess = old_pos + (n - lit_start)
+        if old[guess:guess + KEY] == key:
+            o = guess
+        else:
+            o = index.get(key)
+            if o is None:
+                n += 1
+                continue
+
+        length = match_length(old, new, o, n)
+        if length < KEY:
+            n += 1
+            continue
+
+        ops.append((new[lit_start:n], o - old_pos,
+                    bytes((new[n + i] - old[o + i]) & 0xFF
+                          for i in range(length))))
+        old_pos = o + length
+        n += length
+        lit_start = n
+
+    if lit_start < len(new):
+        ops.append((new[lit_start:], 0, b""))
+    return ops
+
+
+def encode(old, new):
+    body = bytearray()
+    for extra, seek, delta in diff(old, new):
+        body += varint(len(extra)) + varint(zigzag(seek)) + varint(len(delta))
+        body += extra + delta
+
+    comp = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    packed = comp.compress(bytes(body)) + comp.flush()
+    header = HEADER.pack(MAGIC, VERSION, len(new),
+                         hashlib.sha256(new).digest(), elf_sha(old))
+    return header + packed
+
+
+def apply(old, patch):
+    magic, version, size, new_sha, old_sha = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a delta patch")
+    if old_sha != elf_sha(old):
+        raise ValueError("patch was built against a different image")
+
+    body = zlib.decompress(patch[HEADER.size:], -15)
+    pos = old_pos = 0
+    out = bytearray()
+
+    def read_varint():
+        nonlocal pos
+        v = shift = 0
+        while True:
+            b = body[pos]
+            pos += 1
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    while len(out) < size:
+        extra = read_varint()
+        z = read_varint()
+        seek = (z >> 1) ^ -(z & 1)
+        length = read_varint()
+        out += body[pos:pos + extra]
+        pos += extra
+        old_pos += seek
+        out += bytes((old[old_pos + i] + body[pos + i]) & 0xFF
+                     for i in range(length))
+        pos += length
+        old_pos += length
+
+    if hashlib.sha256(out).digest() != new_sha:
+        raise ValueError("SHA-256 mismatch")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[2])
+    parser.add_argument("--apply", action="store_true",
+                        help="rebuild new.bin from old.bin and a patch")
+    parser.add_argument("old")
+    parser.add_argument("new", help="new image, or the patch with --apply")
+    parser.add_argument("out")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    if args.apply:
+        result = apply(old, new)
+    else:
+        result = encode(old, new)
+        print("%s: %d bytes, %.1f%% of %d" %
+              (args.out, len(result), 100.0 * len(result) / len(new), len(new)))
+
+    with open(args.out, "wb") as f:
+        f.write(result)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,151 @@
+"""
+dlog_decode.py
+Turn the binary DBG() stream of lib/DeferredLog back into text using the
+format strings in the firmware ELF.
+
+  python tools/dlog_decode.py .pio/build/esp32/firmware.elf capture.bin
+  python tools/dlog_decode.py .pio/build/esp32/firmware.elf --port COM48
+
+Frame: D1 06 | u8 len | u8 module << 4 | level | u32 ms | u32 fmt address
+       | packed arguments, len counts from the len byte to the end
+Anything between frames (boot ROM, core panics) is passed through as text.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = b"\xd1\x06"
+HEADER = struct.Struct("<BBII")
+MODULES = ["main", "control", "safety", "net"]  # LOG_MODULES order
+LEVELS = ["off", "E", "W", "I", "D"]
+TRUNCATED = 0x08
+
+SPEC = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t|L)?([diouxXcsfFeEgGaAp%])")
+
+
+class Elf:
+    """Just enough ELF32 to read strings from the loaded sections"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError("%s: not a 32-bit ELF" % path)
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, flags, addr, offset,
+             size) = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            # SHF_ALLOC with contents, NOBITS (.bss) has none
+            if flags & 0x2 and sh_type != 8 and addr:
+                self.sections.append((addr, size, offset))
+
+    def string(self, addr):
+        for start, size, offset in self.sections:
+            if start <= addr < start + size:
+                pos = offset + addr - start
+                end = self.data.index(b"\0", pos)
+                return self.data[pos:end].decode("utf-8", "replace")
+        return None
+
+
+def render(fmt, args):
+    pos = 0
+    out = []
+    last = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv in "fFeEgGaA":
+            v, = struct.unpack_from("<d", args, pos)
+            pos += 8
+            conv = conv if conv in "fFeEgG" else "e"
+        elif conv == "s":
+            n = args[pos]
+            v = args[pos + 1:pos + 1 + n].decode("utf-8", "replace")
+            pos += 1 + n
+        elif length == "ll":
+            v, = struct.unpack_from("<q" if conv in "di" else "<Q", args, pos)
+            pos += 8
+        else:
+            v, = struct.unpack_from("<i" if conv in "dic" else "<I", args, pos)
+            pos += 4
+            if conv == "p":
+                flags, conv = "#", "x"
+            elif conv == "u":
+                conv = "d"
+        out.append(("%" + flags + conv) % v)
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def decode(elf, stream, out, follow=False):
+    buf = b""
+    read = getattr(stream, "read1", stream.read)
+    while True:
+        chunk = read(256)
+        if not chunk:
+            if follow:
+                continue
+            break
+        buf += chunk
+        while True:
+            i = buf.find(SYNC)
+            if i < 0:
+                # keep a partial sync byte for the next read
+                keep = 1 if buf.endswith(SYNC[:1]) else 0
+                out.write(buf[:len(buf) - keep].decode("utf-8", "replace"))
+                buf = buf[len(buf) - keep:]
+                break
+            out.write(buf[:i].decode("utf-8", "replace"))
+            buf = buf[i:]
+            if len(buf) < 2 + HEADER.size or len(buf) < 2 + buf[2]:
+                break
+            size, tag, ms, addr = HEADER.unpack_from(buf, 2)
+            record = buf[2:2 + size]
+            fmt = elf.string(addr) if size >= HEADER.size else None
+            if fmt is None:
+                # not a frame after all
+                out.write(buf[:1].decode("utf-8", "replace"))
+                buf = buf[1:]
+                continue
+            buf = buf[2 + size:]
+            module, level = tag >> 4, tag & 0x7
+            try:
+                text = fmt if tag & TRUNCATED else render(fmt, record[HEADER.size:])
+            except (struct.error, IndexError, TypeError, ValueError):
+                text = fmt
+            out.write("[%u] %s %s: %s" % (
+                ms, LEVELS[level] if level < len(LEVELS) else level,
+                MODULES[module] if module < len(MODULES) else module, text))
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[2])
+    parser.add_argument("elf")
+    parser.add_argument("capture", nargs="?", help="raw capture, default stdin")
+    parser.add_argument("--port", help="read a serial port instead (pyserial)")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud, timeout=0.1)
+    elif args.capture:
+        stream = open(args.capture, "rb")
+    else:
+        stream = sys.stdin.buffer
+    decode(elf, stream, sys.stdout, follow=bool(args.port))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
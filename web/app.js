@@ -0,0 +1,144 @@
+function toggleCheckbox(element) {
+  var xhr = new XMLHttpRequest();
+  if(element.checked){ xhr.open("GET", "/gpio?output="+element.id+"&state=1", true); }
+  else { xhr.open("GET", "/gpio?output="+element.id+"&state=0", true); }
+  xhr.send();
+}
+
+// Minimal canvas time-series plot, times are rendered in the browser timezone
+function Chart(canvas, max) {
+  this.canvas = canvas;
+  this.max = max;
+  this.data = [];
+  var self = this;
+  window.addEventListener('resize', function() { self.draw(); });
+}
+
+Chart.prototype.add = function(x, y) {
+  if (isNaN(y)) return;
+  this.data.push([x, y]);
+  if (this.data.length > this.max) this.data.shift();
+  this.draw();
+};
+
+Chart.prototype.draw = function() {
+  var c = this.canvas, d = this.data;
+  var ratio = window.devicePixelRatio || 1;
+  var w = c.clientWidth, h = c.clientHeight;
+  c.width = w * ratio;
+  c.height = h * ratio;
+  var ctx = c.getContext('2d');
+  ctx.setTransform(ratio, 0, 0, ratio, 0, 0);
+  ctx.clearRect(0, 0, w, h);
+  if (d.length < 2) return;
+
+  var x0 = d[0][0], x1 = d[d.length - 1][0];
+  var y0 = d[0][1], y1 = y0;
+  for (var i = 1; i < d.length; i++) {
+    if (d[i][1] < y0) y0 = d[i][1];
+    if (d[i][1] > y1) y1 = d[i][1];
+  }
+  var pad = Math.max((y1 - y0) * 0.1, 5);
+  y0 = Math.floor((y0 - pad) / 10) * 10;
+  y1 = Math.ceil((y1 + pad) / 10) * 10;
+
+  var left = 36, bottom = h - 16;
+  var sx = (w - left - 4) / Math.max(x1 - x0, 1);
+  var sy = (bottom - 4) / (y1 - y0);
+  var style = getComputedStyle(c);
+
+  // grid and labels
+  ctx.font = '10px verdana';
+  ctx.fillStyle = style.color;
+  ctx.strokeStyle = 'rgba(128,128,128,0.3)';
+  ctx.lineWidth = 1;
+  ctx.textAlign = 'right';
+  for (i = 0; i <= 4; i++) {
+    var v = y0 + (y1 - y0) * i / 4;
+    var y = bottom - (v - y0) * sy;
+    ctx.beginPath();
+    ctx.moveTo(left, y);
+    ctx.lineTo(w, y);
+    ctx.stroke();
+    ctx.fillText(v.toFixed(0), left - 4, y + 3);
+  }
+  ctx.textAlign = 'center';
+  for (i = 0; i <= 3; i++) {
+    var t = x0 + (x1 - x0) * i / 3;
+    var label = new Date(t).toLocaleTimeString([], { hour: '2-digit', minute: '2-digit' });
+    ctx.fillText(label, Math.min(Math.max(left + (t - x0) * sx, left + 16), w - 16), h - 4);
+  }
+
+  // series
+  ctx.strokeStyle = '#1fa3ec';
+  ctx.lineWidth = 2;
+  ctx.beginPath();
+  for (i = 0; i < d.length; i++) {
+    var px = left + (d[i][0] - x0) * sx, py = bottom - (d[i][1] - y0) * sy;
+    if (i) ctx.lineTo(px, py); else ctx.moveTo(px, py);
+  }
+  ctx.stroke();
+};
+
+const chart = new Chart(document.getElementById('chart'), 3000);
+// history is [[epoch s, degC], ...]
+for (var index = 0; index < graphData.length; index++)
+  chart.data.push([graphData[index][0] * 1000, graphData[index][1]]);
+chart.draw();
+
+// window.addEventListener('load', getReadings);
+
+function plotTemperature(t) {
+
+  var x = (new Date()).getTime();
+  // console.log(x);
+  // console.log(t);
+
+  chart.add(x, t);
+}
+
+function getReadings(){
+  var xhr = new XMLHttpRequest();
+  xhr.onreadystatechange = function() {
+    if (this.readyState == 4 && this.status == 200) {
+      var myObj = this.responseText;
+      console.log(myObj);
+      var temp = myObj.temperature;
+    }
+  }; 
+  xhr.open("GET", "/readings", true);
+  xhr.send();
+}
+
+if (!!window.EventSource) {
+  var source = new EventSource('/events');
+  
+  source.addEventListener('open', function(e) {
+    console.log("Events Connected");
+  }, false);
+
+  source.addEventListener('error', function(e) {
+    if (e.target.readyState != EventSource.OPEN) {
+      console.log("Events Disconnected");
+    }
+  }, false);
+  
+  source.addEventListener('message', function(e) {
+    console.log("message", e.data);
+  }, false);
+  
+  source.addEventListener('temperature', function(e) {
+    // console.log("temperature", e.data);
+    document.getElementById("temperature").innerHTML = e.data;
+    plotTemperature(parseFloat(e.data));
+  }, false);
+
+  source.addEventListener('KW', function(e) {
+    // console.log("KW", e.data);
+    document.getElementById("KW").innerHTML = e.data;
+  }, false);
+
+  source.addEventListener('display', function(e) {
+    document.getElementById("display").innerHTML = e.data;
+  }, false);
+}